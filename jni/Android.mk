@@ -25,11 +25,22 @@ include ../../OpenCV-2.4.8.2-Tegra-sdk/sdk/native/jni/OpenCV-tegra3.mk
 
 LOCAL_MODULE    := myTangoProject
 LOCAL_SHARED_LIBRARIES += tango_client_api
-LOCAL_CFLAGS    := -Werror -std=c++11
+# Hot-path timers (profiler.h); build with TANGO_PROFILE=0 to remove them
+TANGO_PROFILE   ?= 1
+# Matcher comparison counters (feature.h); follow TANGO_PROFILE by default
+TANGO_MATCH_STATS ?= $(TANGO_PROFILE)
+LOCAL_CFLAGS    := -Werror -std=c++11 -DTANGO_PROFILE=$(TANGO_PROFILE) \
+                   -DTANGO_MATCH_STATS=$(TANGO_MATCH_STATS)
 LOCAL_SRC_FILES := tango_native.cc \
                    tango_handler.cc \
                    yuv_drawable.cc \
                    frame_processor.cc \
+                   frame_arena.cc \
+                   model_database.cc \
+                   model_file.cc.neon \
+                   mih_index.cc \
+                   frame_recording.cc \
+                   profiler.cc \
                    rhorefc.cc \
                    $(TANGO_ROOT)/tango-gl/camera.cpp \
                    $(TANGO_ROOT)/tango-gl/line.cpp \
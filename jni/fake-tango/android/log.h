@@ -0,0 +1,40 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#ifndef FAKE_ANDROID_LOG_H_
+#define FAKE_ANDROID_LOG_H_
+
+#include <stdio.h>
+#include <stdarg.h>
+
+/**
+* Android logging for host builds of the app code (tango-gl logs with
+* __android_log_print): messages go to stderr
+*/
+typedef enum android_LogPriority {
+	ANDROID_LOG_UNKNOWN = 0,
+	ANDROID_LOG_DEFAULT,
+	ANDROID_LOG_VERBOSE,
+	ANDROID_LOG_DEBUG,
+	ANDROID_LOG_INFO,
+	ANDROID_LOG_WARN,
+	ANDROID_LOG_ERROR,
+	ANDROID_LOG_FATAL,
+	ANDROID_LOG_SILENT
+} android_LogPriority;
+
+static inline int __android_log_print(int prio, const char* tag, const char* fmt, ...)
+{
+	static const char levels[] = "??VDIWEFS";
+	va_list args;
+	va_start(args, fmt);
+	fprintf(stderr, "%s %c: ", tag, prio >= 0 && prio <= ANDROID_LOG_SILENT ? levels[prio] : '?');
+	int n = vfprintf(stderr, fmt, args);
+	fputc('\n', stderr);
+	va_end(args);
+	return n;
+}
+
+#endif  // FAKE_ANDROID_LOG_H_
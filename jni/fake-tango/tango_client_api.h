@@ -0,0 +1,183 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#ifndef FAKE_TANGO_CLIENT_API_H_
+#define FAKE_TANGO_CLIENT_API_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+* Stand-in for the Tango client API, for host (Linux) builds
+*
+* Declares the subset of tango_client_api.h used by VideoOverlayApp,
+* with the same names, values and signatures, and implements it over a
+* recording (frame_recording.h): once connected, a thread of the service
+* delivers the recorded NV21 frames to the connectOnFrameAvailable
+* callback at a given rate, as the camera does. Frames whose time has
+* passed while the callback was still running are dropped, not queued.
+* Intrinsics and poses are those of the recording.
+*
+* The recording is given with TangoFake_setRecording(), or by the
+* environment when TangoService_initialize() is called:
+*
+*     TANGO_FAKE_RECORDING   recording file or directory of .nv21 frames
+*     TANGO_FAKE_SIZE        WxH of raw .nv21 frames
+*     TANGO_FAKE_FPS         delivery rate (default 30, 0: back to back)
+*     TANGO_FAKE_PASSES      times the recording is played (default 0:
+*                            until disconnect)
+*
+* There is no GL texture behind connectTextureId/updateTexture.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	TANGO_NO_CAMERA_PERMISSION			= -5,
+	TANGO_NO_ADF_PERMISSION				= -4,
+	TANGO_NO_MOTION_TRACKING_PERMISSION	= -3,
+	TANGO_INVALID						= -2,
+	TANGO_ERROR							= -1,
+	TANGO_SUCCESS						= 0
+} TangoErrorType;
+
+typedef enum {
+	TANGO_CAMERA_COLOR = 0,
+	TANGO_CAMERA_RGBIR,
+	TANGO_CAMERA_FISHEYE,
+	TANGO_CAMERA_DEPTH,
+	TANGO_MAX_CAMERA_ID
+} TangoCameraId;
+
+typedef enum {
+	TANGO_CONFIG_DEFAULT = 0,
+	TANGO_CONFIG_CURRENT,
+	TANGO_CONFIG_MOTION_TRACKING,
+	TANGO_CONFIG_AREA_LEARNING,
+	TANGO_CONFIG_RUNTIME
+} TangoConfigType;
+
+typedef enum {
+	TANGO_COORDINATE_FRAME_GLOBAL_WGS84 = 0,
+	TANGO_COORDINATE_FRAME_AREA_DESCRIPTION,
+	TANGO_COORDINATE_FRAME_START_OF_SERVICE,
+	TANGO_COORDINATE_FRAME_PREVIOUS_DEVICE_POSE,
+	TANGO_COORDINATE_FRAME_DEVICE,
+	TANGO_COORDINATE_FRAME_IMU,
+	TANGO_COORDINATE_FRAME_DISPLAY,
+	TANGO_COORDINATE_FRAME_CAMERA_COLOR,
+	TANGO_COORDINATE_FRAME_CAMERA_DEPTH,
+	TANGO_COORDINATE_FRAME_CAMERA_FISHEYE,
+	TANGO_COORDINATE_FRAME_INVALID,
+	TANGO_MAX_COORDINATE_FRAME_TYPE
+} TangoCoordinateFrameType;
+
+typedef enum {
+	TANGO_POSE_INITIALIZING = 0,
+	TANGO_POSE_VALID,
+	TANGO_POSE_INVALID,
+	TANGO_POSE_UNKNOWN
+} TangoPoseStatusType;
+
+typedef enum {
+	TANGO_HAL_PIXEL_FORMAT_RGBA_8888	= 1,
+	TANGO_HAL_PIXEL_FORMAT_YV12			= 0x32315659,
+	TANGO_HAL_PIXEL_FORMAT_YCrCb_420_SP	= 0x11
+} TangoImageFormatType;
+
+typedef enum {
+	TANGO_CALIBRATION_UNKNOWN = 0,
+	TANGO_CALIBRATION_EQUIDISTANT,
+	TANGO_CALIBRATION_POLYNOMIAL_2_PARAMETERS,
+	TANGO_CALIBRATION_POLYNOMIAL_3_PARAMETERS,
+	TANGO_CALIBRATION_POLYNOMIAL_5_PARAMETERS
+} TangoCalibrationType;
+
+typedef void* TangoConfig;
+
+typedef struct TangoCoordinateFramePair {
+	TangoCoordinateFrameType base;
+	TangoCoordinateFrameType target;
+} TangoCoordinateFramePair;
+
+typedef struct TangoPoseData {
+	uint32_t version;
+	double timestamp;
+	double orientation[4];
+	double translation[3];
+	TangoPoseStatusType status_code;
+	TangoCoordinateFramePair frame;
+	uint32_t confidence;
+	float accuracy;
+} TangoPoseData;
+
+typedef struct TangoImageBuffer {
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	double timestamp;
+	int64_t frame_number;
+	TangoImageFormatType format;
+	uint8_t* data;			// Read-only with the fake service (mapped recording)
+} TangoImageBuffer;
+
+typedef struct TangoCameraIntrinsics {
+	TangoCameraId camera_id;
+	TangoCalibrationType calibration_type;
+	uint32_t width;
+	uint32_t height;
+	double fx;
+	double fy;
+	double cx;
+	double cy;
+	double distortion[5];
+} TangoCameraIntrinsics;
+
+/**
+* Subset of the service used by VideoOverlayApp
+*/
+TangoErrorType TangoService_initialize(void* jni_env, void* activity);
+TangoConfig TangoService_getConfig(TangoConfigType config_type);
+TangoErrorType TangoConfig_setBool(TangoConfig config, const char* key, bool value);
+void TangoConfig_free(TangoConfig config);
+TangoErrorType TangoService_connectOnFrameAvailable(TangoCameraId id, void* context,
+		void (*onFrameAvailable)(void* context, TangoCameraId id,
+								 const TangoImageBuffer* buffer));
+TangoErrorType TangoService_connectTextureId(TangoCameraId id, unsigned int tex,
+		void* context, void (*callback)(void* context, TangoCameraId id));
+TangoErrorType TangoService_connect(void* context, TangoConfig config);
+void TangoService_disconnect(void);
+TangoErrorType TangoService_updateTexture(TangoCameraId id, double* timestamp);
+TangoErrorType TangoService_getCameraIntrinsics(TangoCameraId camera_id,
+		TangoCameraIntrinsics* intrinsics);
+TangoErrorType TangoService_getPoseAtTime(double timestamp, TangoCoordinateFramePair frame,
+		TangoPoseData* pose);
+
+/**
+* Fake service only
+*/
+
+// Recording to play ("width" x "height" for a directory of raw frames).
+// Must be called before connecting.
+TangoErrorType TangoFake_setRecording(const char* path, uint32_t width, uint32_t height);
+
+// Delivery rate (0: next frame as soon as the callback returns) and
+// number of times the recording is played (0: until disconnect)
+void TangoFake_setFrameRate(double fps, uint32_t passes);
+
+// Frames delivered to the callback and dropped because it was still
+// running, since connect
+void TangoFake_getStats(uint32_t* delivered, uint32_t* dropped);
+
+// Wait until every pass has been played, or until disconnect
+void TangoFake_waitForEnd(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // FAKE_TANGO_CLIENT_API_H_
@@ -0,0 +1,392 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "tango_client_api.h"
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/frame_recording.h"
+
+namespace {
+
+typedef std::chrono::steady_clock timer;
+
+typedef void (*frameCallback)(void* context, TangoCameraId id, const TangoImageBuffer* buffer);
+
+struct fakeConfig {
+	TangoConfigType type;
+	bool colorCamera;
+};
+
+/**
+* State of the fake service. The delivery thread reads the recording
+* and the callback, which only change while it is not running.
+*/
+struct fakeService {
+	std::mutex lock;
+	std::condition_variable wakeup;
+
+	frameRecording recording;
+	double fps;
+	uint32_t passes;
+
+	frameCallback onFrame;
+	void* onFrameContext;
+	bool connected;
+	bool colorCamera;
+
+	std::thread delivery;
+	std::atomic<bool> stopping;
+	bool finished;
+
+	// Timestamp offset of the pass being played (timestamps keep
+	// increasing from a pass to the next) and last frame delivered
+	double timeOffset;
+	double lastTimestamp;
+	std::atomic<uint32_t> delivered;
+	std::atomic<uint32_t> dropped;
+
+	fakeService() : fps(30.0), passes(0), onFrame(NULL), onFrameContext(NULL),
+					connected(false), colorCamera(false), stopping(false), finished(false),
+					timeOffset(0.0), lastTimestamp(0.0), delivered(0), dropped(0) {}
+};
+
+fakeService& service(void)
+{
+	static fakeService instance;
+	return instance;
+}
+
+// Recording time between two passes
+double passDuration(const frameRecording& recording, double period)
+{
+	uint32_t n = recording.numFrames();
+	double span = n > 1 ? recording.timestamp(n - 1) - recording.timestamp(0) : 0.0;
+	return span + (period > 0 ? period : 1.0 / 30);
+}
+
+/**
+* Delivery thread: plays the recording on the camera clock. A frame is
+* dropped when its slot is over before the callback returned from the
+* previous one, as the camera does.
+*/
+void deliveryLoop(void)
+{
+	fakeService& s = service();
+	const frameRecording& recording = s.recording;
+	double period = s.fps > 0 ? 1.0 / s.fps : 0.0;
+	timer::duration step = std::chrono::duration_cast<timer::duration>(
+			std::chrono::duration<double>(period));
+
+	TangoImageBuffer buffer;
+	buffer.width	= recording.width();
+	buffer.height	= recording.height();
+	buffer.stride	= recording.width();
+	buffer.format	= TANGO_HAL_PIXEL_FORMAT_YCrCb_420_SP;
+	buffer.frame_number = 0;
+
+	timer::time_point next = timer::now();
+	for(uint32_t pass = 0; !s.passes || pass < s.passes; pass++){
+		{
+			std::lock_guard<std::mutex> lock(s.lock);
+			s.timeOffset = pass * passDuration(recording, period);
+		}
+		for(uint32_t f = 0; f < recording.numFrames(); f++){
+			if(period > 0){
+				if(timer::now() >= next + step){
+					next += step;
+					s.dropped++;
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(s.lock);
+				s.wakeup.wait_until(lock, next, [&s] { return s.stopping.load(); });
+				next += step;
+			}
+			if(s.stopping){
+				return;
+			}
+
+			buffer.timestamp = recording.timestamp(f) + s.timeOffset;
+			buffer.frame_number++;
+			buffer.data = const_cast<uint8_t*>(recording.frame(f));
+			s.onFrame(s.onFrameContext, TANGO_CAMERA_COLOR, &buffer);
+			s.delivered++;
+			{
+				std::lock_guard<std::mutex> lock(s.lock);
+				s.lastTimestamp = buffer.timestamp;
+			}
+		}
+	}
+	std::lock_guard<std::mutex> lock(s.lock);
+	s.finished = true;
+	s.wakeup.notify_all();
+}
+
+void stopDelivery(fakeService& s)
+{
+	{
+		std::lock_guard<std::mutex> lock(s.lock);
+		s.stopping = true;
+	}
+	s.wakeup.notify_all();
+	if(s.delivery.joinable()){
+		s.delivery.join();
+	}
+}
+
+}  // namespace
+
+extern "C" {
+
+TangoErrorType TangoService_initialize(void*, void*)
+{
+	fakeService& s = service();
+	const char* path = getenv("TANGO_FAKE_RECORDING");
+	if(path && !s.recording.numFrames()){
+		uint32_t width = 0, height = 0;
+		const char* size = getenv("TANGO_FAKE_SIZE");
+		if(size && sscanf(size, "%ux%u", &width, &height) != 2){
+			LOG_E("Error: TANGO_FAKE_SIZE must be WxH!\n");
+			return TANGO_INVALID;
+		}
+		if(TangoFake_setRecording(path, width, height) != TANGO_SUCCESS){
+			return TANGO_ERROR;
+		}
+	}
+	const char* fps = getenv("TANGO_FAKE_FPS");
+	const char* passes = getenv("TANGO_FAKE_PASSES");
+	TangoFake_setFrameRate(fps ? atof(fps) : s.fps, passes ? atoi(passes) : s.passes);
+	return TANGO_SUCCESS;
+}
+
+TangoConfig TangoService_getConfig(TangoConfigType config_type)
+{
+	fakeConfig* config = new fakeConfig;
+	config->type		= config_type;
+	config->colorCamera	= false;
+	return config;
+}
+
+TangoErrorType TangoConfig_setBool(TangoConfig config, const char* key, bool value)
+{
+	if(!config || !key){
+		return TANGO_INVALID;
+	}
+	// Other keys are accepted and have no effect
+	if(std::string(key) == "config_enable_color_camera"){
+		static_cast<fakeConfig*>(config)->colorCamera = value;
+	}
+	return TANGO_SUCCESS;
+}
+
+void TangoConfig_free(TangoConfig config)
+{
+	delete static_cast<fakeConfig*>(config);
+}
+
+TangoErrorType TangoService_connectOnFrameAvailable(TangoCameraId id, void* context,
+		void (*onFrameAvailable)(void* context, TangoCameraId id,
+								 const TangoImageBuffer* buffer))
+{
+	fakeService& s = service();
+	if(id != TANGO_CAMERA_COLOR){
+		return TANGO_INVALID;
+	}
+	if(s.connected){
+		return TANGO_ERROR;
+	}
+	s.onFrame		 = onFrameAvailable;
+	s.onFrameContext = context;
+	return TANGO_SUCCESS;
+}
+
+TangoErrorType TangoService_connectTextureId(TangoCameraId id, unsigned int, void*,
+		void (*)(void*, TangoCameraId))
+{
+	return id == TANGO_CAMERA_COLOR ? TANGO_SUCCESS : TANGO_INVALID;
+}
+
+TangoErrorType TangoService_connect(void*, TangoConfig config)
+{
+	fakeService& s = service();
+	if(!config){
+		return TANGO_INVALID;
+	}
+	if(s.connected){
+		return TANGO_SUCCESS;
+	}
+	s.colorCamera = static_cast<fakeConfig*>(config)->colorCamera;
+	if(s.colorCamera && s.onFrame){
+		if(!s.recording.numFrames()){
+			LOG_E("Error: Fake Tango service has no recording to play!\n");
+			return TANGO_ERROR;
+		}
+		s.stopping		= false;
+		s.finished		= false;
+		s.timeOffset	= 0.0;
+		s.lastTimestamp	= 0.0;
+		s.delivered		= 0;
+		s.dropped		= 0;
+		s.delivery		= std::thread(deliveryLoop);
+	}
+	s.connected = true;
+	return TANGO_SUCCESS;
+}
+
+void TangoService_disconnect(void)
+{
+	fakeService& s = service();
+	stopDelivery(s);
+	// As the service does, forget the callbacks
+	s.onFrame		 = NULL;
+	s.onFrameContext = NULL;
+	s.connected		 = false;
+}
+
+TangoErrorType TangoService_updateTexture(TangoCameraId id, double* timestamp)
+{
+	fakeService& s = service();
+	if(id != TANGO_CAMERA_COLOR || !s.connected){
+		return TANGO_ERROR;
+	}
+	std::lock_guard<std::mutex> lock(s.lock);
+	*timestamp = s.lastTimestamp;
+	return TANGO_SUCCESS;
+}
+
+TangoErrorType TangoService_getCameraIntrinsics(TangoCameraId camera_id,
+		TangoCameraIntrinsics* intrinsics)
+{
+	const frameRecording& recording = service().recording;
+	if(camera_id != TANGO_CAMERA_COLOR || !intrinsics || !recording.numFrames()){
+		return TANGO_ERROR;
+	}
+	intrinsics->camera_id = camera_id;
+	const recordingIntrinsics* recorded = recording.intrinsics();
+	if(recorded){
+		intrinsics->calibration_type = static_cast<TangoCalibrationType>(recorded->model);
+		intrinsics->width	= recorded->width;
+		intrinsics->height	= recorded->height;
+		intrinsics->fx		= recorded->fx;
+		intrinsics->fy		= recorded->fy;
+		intrinsics->cx		= recorded->cx;
+		intrinsics->cy		= recorded->cy;
+		for(int i = 0; i < 5; i++){
+			intrinsics->distortion[i] = recorded->distortion[i];
+		}
+		return TANGO_SUCCESS;
+	}
+
+	// Raw frames: pinhole camera of about 53 degrees horizontal field
+	intrinsics->calibration_type = TANGO_CALIBRATION_UNKNOWN;
+	intrinsics->width	= recording.width();
+	intrinsics->height	= recording.height();
+	intrinsics->fx		= intrinsics->fy = recording.width();
+	intrinsics->cx		= recording.width() / 2.0;
+	intrinsics->cy		= recording.height() / 2.0;
+	for(int i = 0; i < 5; i++){
+		intrinsics->distortion[i] = 0.0;
+	}
+	return TANGO_SUCCESS;
+}
+
+TangoErrorType TangoService_getPoseAtTime(double timestamp, TangoCoordinateFramePair frame,
+		TangoPoseData* pose)
+{
+	fakeService& s = service();
+	if(!pose){
+		return TANGO_INVALID;
+	}
+	memset(pose, 0, sizeof(*pose));
+	pose->frame			= frame;
+	pose->status_code	= TANGO_POSE_INVALID;
+	pose->orientation[3] = 1.0;
+
+	/**
+	 * Only the device in the start-of-service frame is recorded. The
+	 * nearest recorded pose is returned; timestamp 0 asks for the latest.
+	 */
+	const std::vector<recordingPose>& poses = s.recording.poses();
+	if(frame.base != TANGO_COORDINATE_FRAME_START_OF_SERVICE ||
+	   frame.target != TANGO_COORDINATE_FRAME_DEVICE || poses.empty()){
+		return TANGO_SUCCESS;
+	}
+	double offset;
+	{
+		std::lock_guard<std::mutex> lock(s.lock);
+		offset = s.timeOffset;
+		if(timestamp == 0.0){
+			timestamp = s.lastTimestamp;
+		}
+	}
+	double t = timestamp - offset;
+	std::vector<recordingPose>::const_iterator it = std::lower_bound(poses.begin(), poses.end(),
+			t, [](const recordingPose& p, double time) { return p.timestamp < time; });
+	if(it == poses.end() || (it != poses.begin() && t - (it - 1)->timestamp < it->timestamp - t)){
+		--it;
+	}
+	pose->timestamp		= it->timestamp + offset;
+	pose->status_code	= static_cast<TangoPoseStatusType>(it->status);
+	for(int i = 0; i < 3; i++){
+		pose->translation[i] = it->translation[i];
+	}
+	for(int i = 0; i < 4; i++){
+		pose->orientation[i] = it->orientation[i];
+	}
+	return TANGO_SUCCESS;
+}
+
+TangoErrorType TangoFake_setRecording(const char* path, uint32_t width, uint32_t height)
+{
+	fakeService& s = service();
+	if(s.connected || !path){
+		return TANGO_ERROR;
+	}
+	if(s.recording.open(path, width, height) != RET_SUCCESS || !s.recording.numFrames()){
+		LOG_E("Error: Could not open recording %s!\n", path);
+		s.recording.close();
+		return TANGO_ERROR;
+	}
+	return TANGO_SUCCESS;
+}
+
+void TangoFake_setFrameRate(double fps, uint32_t passes)
+{
+	fakeService& s = service();
+	if(!s.connected){
+		s.fps	 = std::max(0.0, fps);
+		s.passes = passes;
+	}
+}
+
+void TangoFake_getStats(uint32_t* delivered, uint32_t* dropped)
+{
+	fakeService& s = service();
+	if(delivered){
+		*delivered = s.delivered;
+	}
+	if(dropped){
+		*dropped = s.dropped;
+	}
+}
+
+void TangoFake_waitForEnd(void)
+{
+	fakeService& s = service();
+	std::unique_lock<std::mutex> lock(s.lock);
+	if(s.delivery.joinable()){
+		s.wakeup.wait(lock, [&s] { return s.finished || s.stopping.load(); });
+	}
+}
+
+}  // extern "C"
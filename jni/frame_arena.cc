@@ -0,0 +1,81 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#include <stdlib.h>
+#include "tango-video-handler/frame_arena.h"
+
+static inline size_t alignUp(size_t v, size_t align)
+{
+	return (v + align - 1) & ~(align - 1);
+}
+
+frameArena::frameArena(size_t initSize) :
+		block(NULL), size(0), offset(0), overflowBytes(0)
+{
+	block = (uint8_t*)malloc(initSize);
+	if(block){
+		size = initSize;
+	}
+}
+
+frameArena::~frameArena()
+{
+	releaseOverflow();
+	free(block);
+}
+
+void frameArena::reset(void)
+{
+	/**
+	 * Grow the backing block to cover the whole of the previous frame.
+	 * This is the only place where the block is reallocated, so pointers
+	 * handed out during a frame never move.
+	 */
+	if(overflowBytes){
+		size_t need = alignUp(offset + overflowBytes + overflow.size() * ARENA_ALIGN,
+							  ARENA_ALIGN);
+		releaseOverflow();
+
+		uint8_t* grown = (uint8_t*)malloc(need);
+		if(grown){
+			free(block);
+			block = grown;
+			size  = need;
+		}
+	}
+	offset = 0;
+}
+
+void* frameArena::alloc(size_t bytes, size_t align)
+{
+	size_t base	 = (size_t)block;
+	size_t start = alignUp(base + offset, align) - base;
+
+	if(block && start + bytes <= size){
+		offset = start + bytes;
+		return block + start;
+	}
+
+	/**
+	 * Out of space: serve from the heap for this frame only.
+	 */
+	void* p = NULL;
+	if(posix_memalign(&p, align < sizeof(void*) ? sizeof(void*) : align,
+					  bytes ? bytes : 1) != 0){
+		return NULL;
+	}
+	overflow.push_back(p);
+	overflowBytes += bytes;
+	return p;
+}
+
+void frameArena::releaseOverflow(void)
+{
+	for(size_t i = 0; i < overflow.size(); i++){
+		free(overflow[i]);
+	}
+	overflow.clear();
+	overflowBytes = 0;
+}
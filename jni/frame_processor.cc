@@ -3,131 +3,493 @@
  * Author: Hamid Bazargani
  */
 
+#include <algorithm>
 #include "tango-video-handler/param.h"
+#include "tango-video-handler/profiler.h"
 #include "tango-video-handler/frame_processor.h"
 
 using namespace cv;
 
-frameProcessor::frameProcessor()
+frameProcessor::frameProcessor() : matching(MATCH_BY_FEATURE), probeBudget(0), maxVotes(0),
+								   mihStamp(0), model(std::make_shared<modelDatabase>()), published(model),
+								   pendingModel(NULL), loadRequested(false), loaderRunning(false),
+								   loadStatus(MODEL_LOAD_NONE)
 {
+	rho = rhoRefCInit();
+	matches.reserve(2*MAX_TOTAL_MATCH);
+	keypoints.reserve(MAX_FRAME_KEYPOINTS);
 }
 
 frameProcessor::~frameProcessor()
 {
+	// Let the running load finish, but start no other
+	{
+		std::lock_guard<std::mutex> lock(loadLock);
+		loadRequested = false;
+	}
+	if(loader.joinable()){
+		loader.join();
+	}
+	delete pendingModel.exchange(NULL);
+	if(rho){
+		rhoRefCFini(rho);
+	}
 }
 
 int frameProcessor::processFrame(const Mat& input, Mat& output)
 {
-	output = input.clone();
-	int status = RET_SUCCESS;
+	PROFILE_SCOPE(ZONE_PROCESS_FRAME);
 
-	Mat gray;
-	cvtColor(input, gray, CV_RGB2GRAY);
-	//GaussianBlur(gray, gray, Size(3,3), 1, 1);
+	/**
+	 * Everything below reuses buffers from previous frames; the arena
+	 * hands back the scratch memory of the last frame.
+	 */
+	arena.reset();
+	installPendingModel();
 
-	vector<Mat> scales;
-	scales.push_back(gray);
-	scales.push_back(Mat(gray.rows/2, gray.cols/2, CV_8UC1));
-	scales.push_back(Mat(gray.rows/4, gray.cols/4, CV_8UC1));
+	if(output.data != input.data){
+		input.copyTo(output);
+	}
+	detections.clear();
+	timing.reset();
+
+	/**
+	 * One vote counter per target (only resized when the model changed)
+	 */
+	uint32_t numTargets = model->numTargets();
+	if(targetVotes.size() != numTargets){
+		targetVotes.assign(numTargets, 0);
+	}
+	if(!numTargets){
+		return RET_FAILED;
+	}
+
+	PROFILE_TIMER(pyramidTimer, ZONE_PYRAMID, &timing.ns[STAGE_PYRAMID]);
+	cvtColor(input, scales[0], CV_RGB2GRAY);
+	//GaussianBlur(gray, gray, Size(3,3), 1, 1);
 
 	/**
 	 * Pyramid down to the half- and quarter-scales of the frame.
 	 */
 	resize(scales[0], scales[1], Size(), 0.5, 0.5, INTER_AREA);
 	resize(scales[1], scales[2], Size(), 0.5, 0.5, INTER_AREA);
+	PROFILE_STOP(pyramidTimer);
 
-	int i, pyramid = 0;
-	for( ; pyramid < 3 && matches.size() <= MAX_TOTAL_MATCH; pyramid++){
-		vector<Feature> rtFeature;
+	/**
+	 * Without multi-probe, the levels are visited from full-scale down
+	 * until one target has more than MAX_TOTAL_MATCH votes. With
+	 * multi-probe each level yields more matches, so the pyramid is
+	 * walked coarse-to-fine and the expensive full-scale level is skipped
+	 * once one target has MIN_NUM_MATCHES votes. Matches spread over
+	 * many targets do not stop the walk: each target is estimated on its
+	 * own votes.
+	 */
+	uint32_t i;
+	int level;
+	int hashWidth = model->hashBits() - MIN_HASH_BITS;
+	describeFn describe = describers[hashWidth];
+
+	for(level = 0; level < 3; level++){
+		int pyramid = probeBudget ? 2 - level : level;
+		if(maxVotes > MAX_TOTAL_MATCH || (probeBudget && maxVotes >= MIN_NUM_MATCHES)){
+			break;
+		}
 
 		/**
 		 * Extract features for the query pyramid level
 		 */
-		extractFeatures(scales[pyramid], rtFeature);
+		PROFILE_TIMER(fastTimer, ZONE_FAST, &timing.ns[STAGE_FAST]);
+		FAST(scales[pyramid], keypoints, FAST_THRSH);
+		PROFILE_STOP(fastTimer);
+
+		featureSet rtFeature;
+		rtFeature.descriptors = arena.alloc<Descriptor>(keypoints.size());
+		rtFeature.locations	  = arena.alloc<featureLocation>(keypoints.size());
+		rtFeature.indices	  = arena.alloc<uint32_t>(keypoints.size());
+		uint32_t* rtProbes = probeBudget ?
+				arena.alloc<uint32_t>(keypoints.size()*MAX_PROBES) : NULL;
+		PROFILE_TIMER(briefTimer, ZONE_BRIEF, &timing.ns[STAGE_BRIEF]);
+		uint32_t numFeatures = (this->*describe)(scales[pyramid], keypoints,
+												 rtFeature, rtProbes);
+		PROFILE_STOP(briefTimer);
 
 		/**
 		 * Match extracted features against the target model
 		 */
-		findBRIEFMatches(rtFeature, pyramid);
+		PROFILE_TIMER(matchTimer, ZONE_MATCH, &timing.ns[STAGE_MATCH]);
+		matchLevel(rtFeature, rtProbes, numFeatures, pyramid);
+		PROFILE_STOP(matchTimer);
 	}
 
 	/**
-	 * Sort matches by Hamming distance (PROSAC mode)
+	 * Group the matches by target and sort each group by Hamming distance
+	 * (PROSAC mode). Only targets with at least MIN_NUM_MATCHES votes are
+	 * kept.
+	 *
+	 * Distances are bounded by MIN_HAMMING_DIST, so a counting sort over
+	 * a (target, distance) histogram places every match directly at its
+	 * final position in the src/dst arrays, the groups being contiguous.
 	 */
-	vector<Point2f> srcSorted, dstSorted;
-	std::sort(matches.begin(), matches.end());
+	PROFILE_TIMER(sortTimer, ZONE_SORT, &timing.ns[STAGE_SORT]);
+	const uint32_t numDist = MIN_HAMMING_DIST + 1;
+	int32_t* slot = arena.alloc<int32_t>(numTargets);
+	uint32_t numCandidates = 0;
 
-	for(i = 0; i < matches.size(); i++){
-		srcSorted.push_back(srcPoints[matches[i].queryIdx]);
-		dstSorted.push_back(dstPoints[matches[i].trainIdx]);
+	for(i = 0; i < numTargets; i++){
+		slot[i] = targetVotes[i] >= MIN_NUM_MATCHES ? (int32_t)numCandidates++ : -1;
+	}
+
+	uint32_t* distHist	  = arena.alloc<uint32_t>(numCandidates*numDist + 1);
+	uint16_t* candidates  = arena.alloc<uint16_t>(numCandidates);
+	memset(distHist, 0, (numCandidates*numDist + 1)*sizeof(uint32_t));
+
+	for(i = 0; i < numTargets; i++){
+		if(slot[i] >= 0){
+			candidates[slot[i]] = i;
+		}
+	}
+
+	unsigned npoints = matches.size();
+	for(i = 0; i < npoints; i++){
+		int32_t s = slot[matches[i].target];
+		if(s >= 0){
+			distHist[s*numDist + matches[i].distance]++;
+		}
+	}
+
+	uint32_t offset = 0;
+	for(i = 0; i <= numCandidates*numDist; i++){
+		uint32_t count = distHist[i];
+		distHist[i]    = offset;
+		offset        += count;
+	}
+
+	float* srcSorted = arena.alloc<float>(2*offset);
+	float* dstSorted = arena.alloc<float>(2*offset);
+
+	for(i = 0; i < npoints; i++){
+		const D_MATCH& match = matches[i];
+		int32_t s = slot[match.target];
+		if(s < 0){
+			continue;
+		}
+		uint32_t pos = distHist[s*numDist + match.distance]++;
+		srcSorted[2*pos]   = match.src[0];
+		srcSorted[2*pos+1] = match.src[1];
+		dstSorted[2*pos]   = match.dst[0];
+		dstSorted[2*pos+1] = match.dst[1];
 	}
 
 	/**
-	 * Clear unnecessary data
+	 * Clear unnecessary data (capacity is kept for the next frame)
 	 */
 	matches.clear();
-	srcPoints.clear();
-	dstPoints.clear();
-
-	status |= estimateH(dstSorted, srcSorted);
+	std::fill(targetVotes.begin(), targetVotes.end(), 0);
+	maxVotes = 0;
+	PROFILE_STOP(sortTimer);
 
-	if(!status){
-		/**
-		 * Draw bounding polygon around the target
-		 */
-		status |= drawTargetBox(output, CV_RGB(0, 0, 255));
+	/**
+	 * Estimate the homography of every candidate target. After the
+	 * scatter, distHist[s*numDist + MIN_HAMMING_DIST] is the end of group s.
+	 */
+	PROFILE_TIMER(rhoTimer, ZONE_RHO, &timing.ns[STAGE_RHO]);
+	int status = RET_FAILED;
+	uint32_t start = 0;
+	for(uint32_t s = 0; s < numCandidates; s++){
+		uint32_t end = distHist[s*numDist + MIN_HAMMING_DIST];
+		targetDetection detection;
+		detection.target = candidates[s];
+
+		if(estimateH(dstSorted + 2*start, srcSorted + 2*start, end - start,
+					 detection.H, detection.numInliers) == RET_SUCCESS){
+			detections.push_back(detection);
+
+			/**
+			 * Draw bounding polygon around the target
+			 */
+			drawTargetBox(output, detection, CV_RGB(0, 0, 255));
+			status = RET_SUCCESS;
+		}
+		start = end;
 	}
+	PROFILE_STOP(rhoTimer);
 
 	return status;
 }
 
-void frameProcessor::findBRIEFMatches(vector<Feature>& features, int pyramid)
+/**
+* Models built with a descriptor index are always matched through it
+*/
+void frameProcessor::matchLevel(const featureSet& features, const uint32_t* probes,
+								uint32_t numFeatures, int pyramid)
 {
-    uint32_t i, j, k;
-    uint32_t mc = matches.size();
-    for (i = 0; i < features.size(); i++){
+	if(!model->mih().empty()){
+		findBRIEFMatchesMIH(features, numFeatures, pyramid);
+	}else if(matching == MATCH_BY_BUCKET){
+		matchFn matchByBucket = bucketMatchers[model->hashBits() - MIN_HASH_BITS];
+		(this->*matchByBucket)(features, probes, numFeatures, pyramid);
+	}else{
+		findBRIEFMatches(features, probes, numFeatures, pyramid);
+	}
+}
 
-    	Feature&  feature_i	= features[i];
-    	uint32_t minDistIdx = 0;	    			//Minimum distance index
-    	uint16_t minDist    = DESCRIPTOR_LENGTH;   	//Minimum distance set at maximum value
-    	uint32_t comp[DESCRIPTOR_SIZE];
+uint32_t frameProcessor::matchFeatures(const featureSet& features, const uint32_t* probes,
+									   uint32_t numFeatures)
+{
+	arena.reset();
+	installPendingModel();
+	matches.clear();
+	targetVotes.assign(model->numTargets(), 0);
+	maxVotes = 0;
+	if(!model->numTargets()){
+		return 0;
+	}
+	matchLevel(features, probes, numFeatures, 0);
+	return matches.size();
+}
 
-    	// Index table corresponding to the current index
-    	vector<uint32_t> dstIdxTbl 	= indexTbl[feature_i.index];
+void frameProcessor::findBRIEFMatches(const featureSet& features, const uint32_t* probes,
+									  uint32_t numFeatures, int pyramid)
+{
+    uint32_t i, j, p;
+    float scale = (float)(1<<pyramid);
+    for (i = 0; i < numFeatures; i++){
 
-		/**
-		 * Scan the table and compare with "features <vector>"
-		 * to find the one with minimum Hamming distance.
-		 */
-    	for (j = 0; j < dstIdxTbl.size(); j++ ){
+    	const uint32_t* descriptor_i = features.descriptors[i].bits;
+    	uint32_t minDistIdx = 0;	    			//Minimum distance index
+    	uint16_t minDist    = MIN_HAMMING_DIST + 1;	//Minimum distance set at rejection value
+
+    	/**
+    	 * Scan the bucket of the feature, then the multi-probe buckets
+    	 * (filled front to back, NO_PROBE terminated).
+    	 */
+    	for (p = 0; p <= MAX_PROBES; p++){
+
+    		uint32_t bucket = features.indices[i];
+    		if (p > 0){
+    			if (!probes || probes[i*MAX_PROBES + p - 1] == NO_PROBE){
+    				break;
+    			}
+    			bucket = probes[i*MAX_PROBES + p - 1];
+    		}
 
-    		// Get the index of featureTable pointing to the right location
-    		uint32_t tIdx 		= dstIdxTbl[j];
-			Feature& feature_t 	= featureTable[tIdx];
+    		// Index table corresponding to the current index
+    		const vector<uint32_t>& dstIdxTbl = model->bucket(bucket);
 
-    		for (k = 0; k < DESCRIPTOR_SIZE; k++){
-    			comp[k] = (feature_i.descriptor[k] ^ feature_t.descriptor[k]);
-    		}
+    		/**
+    		 * Scan the table and compare with "features <vector>"
+    		 * to find the one with minimum Hamming distance.
+    		 */
+    		for (j = 0; j < dstIdxTbl.size(); j++ ){
 
-    		int dist = descriptorBitCount(comp);
+    			// Get the index of the model feature
+    			uint32_t tIdx 		= dstIdxTbl[j];
 
-    		if (dist < minDist){
-    			minDist    = dist;
-    			minDistIdx = tIdx;
+    			// Candidates that cannot beat minDist are abandoned early
+    			int dist = descriptorDistance(descriptor_i, model->descriptor(tIdx).bits,
+    										  minDist, stats.words);
+
+    			if (dist < minDist){
+    				minDist    = dist;
+    				minDistIdx = tIdx;
+    			}
     		}
+    		MATCH_STATS_ADD(stats.candidates, dstIdxTbl.size());
     	}
 
     	// Push the best match to "matches <vector>"
     	if (minDist <= MIN_HAMMING_DIST){
-    		Feature& feature_t = featureTable[minDistIdx];
-    		D_MATCH match = {mc, mc++, minDist};
+    		const featureLocation& loc_i = features.locations[i];
+    		const featureLocation& loc_t = model->location(minDistIdx);
+    		uint16_t target = model->featureTarget(minDistIdx);
+    		D_MATCH match = {{loc_i.x*scale, loc_i.y*scale},
+    						 {(float)loc_t.x, (float)loc_t.y},
+    						 minDist, target};
     		matches.push_back(match);
-    		srcPoints.push_back(Point2f(feature_i.x, feature_i.y)*(1<<pyramid));
-			dstPoints.push_back(Point2f(feature_t.x, feature_t.y));
+    		vote(target);
     	}
     }
 }
 
+template<int BITS>
+void frameProcessor::findBRIEFMatchesByBucket(const featureSet& features,
+											  const uint32_t* probes,
+											  uint32_t numFeatures, int pyramid)
+{
+	const uint32_t numBuckets = 1u << BITS;
+	uint32_t i, j, p, q;
+	float scale = (float)(1<<pyramid);
+	uint32_t numProbes = probes ? MAX_PROBES : 0;
+
+	/**
+	 * Sort the (bucket, query) pairs by bucket. Every query contributes
+	 * its own index and its valid multi-probe buckets.
+	 */
+	uint32_t* minDistIdx  = arena.alloc<uint32_t>(numFeatures);
+	uint16_t* minDist	  = arena.alloc<uint16_t>(numFeatures);
+	uint32_t  numEntries  = 0;
+
+	for (i = 0; i < numFeatures; i++){
+		numEntries++;
+		for (p = 0; p < numProbes && probes[i*MAX_PROBES + p] != NO_PROBE; p++){
+			numEntries++;
+		}
+		minDist[i]    = MIN_HAMMING_DIST + 1;
+		minDistIdx[i] = 0;
+	}
+
+	uint32_t* order		  = arena.alloc<uint32_t>(numEntries);
+	uint32_t* orderBucket = arena.alloc<uint32_t>(numEntries);
+
+	if (BITS <= DEFAULT_HASH_BITS){
+		/**
+		 * Counting sort over the buckets: the histogram is small enough
+		 * to clear every level.
+		 */
+		uint32_t* bucketStart = arena.alloc<uint32_t>(numBuckets + 1);
+		memset(bucketStart, 0, (numBuckets + 1) * sizeof(uint32_t));
+		for (i = 0; i < numFeatures; i++){
+			bucketStart[features.indices[i] + 1]++;
+			for (p = 0; p < numProbes && probes[i*MAX_PROBES + p] != NO_PROBE; p++){
+				bucketStart[probes[i*MAX_PROBES + p] + 1]++;
+			}
+		}
+		for (i = 0; i < numBuckets; i++){
+			bucketStart[i + 1] += bucketStart[i];
+		}
+		for (i = 0; i < numFeatures; i++){
+			uint32_t bucket = features.indices[i];
+			for (p = 0; ; p++){
+				uint32_t pos = bucketStart[bucket]++;
+				order[pos]		 = i;
+				orderBucket[pos] = bucket;
+				if (p >= numProbes || probes[i*MAX_PROBES + p] == NO_PROBE){
+					break;
+				}
+				bucket = probes[i*MAX_PROBES + p];
+			}
+		}
+	}else{
+		/**
+		 * Wide indices have far more buckets than entries: sort the
+		 * (bucket, query) keys instead of clearing a histogram.
+		 */
+		uint64_t* keys = arena.alloc<uint64_t>(numEntries);
+		uint32_t  k    = 0;
+		for (i = 0; i < numFeatures; i++){
+			keys[k++] = ((uint64_t)features.indices[i] << 32) | i;
+			for (p = 0; p < numProbes && probes[i*MAX_PROBES + p] != NO_PROBE; p++){
+				keys[k++] = ((uint64_t)probes[i*MAX_PROBES + p] << 32) | i;
+			}
+		}
+		std::sort(keys, keys + numEntries);
+		for (k = 0; k < numEntries; k++){
+			order[k]	   = (uint32_t)keys[k];
+			orderBucket[k] = (uint32_t)(keys[k] >> 32);
+		}
+	}
+
+	/**
+	 * Visit the occupied buckets in ascending order. Every model feature
+	 * of the bucket is loaded once and compared against all the queries
+	 * that hashed there, while the next occupied bucket is prefetched.
+	 */
+	uint32_t next = 0;
+	while (next < numEntries){
+		uint32_t first	= next;
+		uint32_t bucket	= orderBucket[first];
+		while (++next < numEntries && orderBucket[next] == bucket);
+
+		if (next < numEntries){
+			const vector<uint32_t>& nextTbl = model->bucket(orderBucket[next]);
+			if (!nextTbl.empty()){
+				__builtin_prefetch(&nextTbl[0]);
+				__builtin_prefetch(&model->descriptor(nextTbl[0]));
+			}
+		}
+
+		const vector<uint32_t>& dstIdxTbl = model->bucket(bucket);
+		for (j = 0; j < dstIdxTbl.size(); j++){
+
+			uint32_t tIdx = dstIdxTbl[j];
+			const uint32_t* descriptor_t = model->descriptor(tIdx).bits;
+
+			if (j + 1 < dstIdxTbl.size()){
+				__builtin_prefetch(&model->descriptor(dstIdxTbl[j + 1]));
+			}
+
+			for (q = first; q < next; q++){
+				uint32_t qIdx = order[q];
+
+				int dist = descriptorDistance(features.descriptors[qIdx].bits, descriptor_t,
+											  minDist[qIdx], stats.words);
+
+				if (dist < minDist[qIdx]){
+					minDist[qIdx]	 = dist;
+					minDistIdx[qIdx] = tIdx;
+				}
+			}
+		}
+		MATCH_STATS_ADD(stats.candidates, (uint64_t)dstIdxTbl.size() * (next - first));
+	}
+
+	/**
+	 * Push the best matches to "matches <vector>"
+	 */
+	for (i = 0; i < numFeatures; i++){
+		if (minDist[i] <= MIN_HAMMING_DIST){
+			const featureLocation& loc_i = features.locations[i];
+			const featureLocation& loc_t = model->location(minDistIdx[i]);
+			uint16_t target = model->featureTarget(minDistIdx[i]);
+			D_MATCH match = {{loc_i.x*scale, loc_i.y*scale},
+							 {(float)loc_t.x, (float)loc_t.y},
+							 minDist[i], target};
+			matches.push_back(match);
+			vote(target);
+		}
+	}
+}
+
+void frameProcessor::findBRIEFMatchesMIH(const featureSet& features, uint32_t numFeatures,
+										 int pyramid)
+{
+	float scale = (float)(1<<pyramid);
+	const mihIndex& mih = model->mih();
+	const Descriptor* modelDescriptors = model->descriptors();
+
+	/**
+	 * One visit stamp per model feature, kept across frames and models.
+	 * Every query takes the next stamp, so entries left by earlier
+	 * queries never match it and the array is only cleared when the
+	 * counter wraps.
+	 */
+	if (mihStamps.size() < model->numFeatures()){
+		mihStamps.resize(model->numFeatures(), 0);
+	}
+	uint32_t* stamps = &mihStamps[0];
+
+	for (uint32_t i = 0; i < numFeatures; i++){
+		if (++mihStamp == 0){
+			std::fill(mihStamps.begin(), mihStamps.end(), 0);
+			mihStamp = 1;
+		}
+		uint32_t minDistIdx = 0;
+		int minDist = mih.nearest(features.descriptors[i].bits, MIN_HAMMING_DIST, modelDescriptors,
+								  stamps, mihStamp, minDistIdx, stats.candidates, stats.words);
+
+		if (minDist <= MIN_HAMMING_DIST){
+			const featureLocation& loc_i = features.locations[i];
+			const featureLocation& loc_t = model->location(minDistIdx);
+			uint16_t target = model->featureTarget(minDistIdx);
+			D_MATCH match = {{loc_i.x*scale, loc_i.y*scale},
+							 {(float)loc_t.x, (float)loc_t.y},
+							 (uint16_t)minDist, target};
+			matches.push_back(match);
+			vote(target);
+		}
+	}
+}
+
 int frameProcessor::configProcessor(void)
 {
 	return RET_SUCCESS;
@@ -138,21 +500,50 @@ int frameProcessor::releaseProcessor(void)
 	return RET_SUCCESS;
 }
 
-void frameProcessor::extractFeatures(const Mat& input,
-									 vector<Feature>& features) const
+void frameProcessor::extractFeatures(const Mat& input, vector<Feature>& features,
+									 int hashBits) const
 {
 	vector<KeyPoint> 	keypoints;
-	uint32_t			i, kpnt;
 
     /**
      * extract FAST features (non-max suppression enabled)
      */
 	FAST(input, keypoints, FAST_THRSH);
 
+	/**
+	 * Describe into the matcher layout, then gather the records
+	 */
+	descriptorArray				descriptors(keypoints.size());
+	vector<featureLocation>		locations(keypoints.size());
+	vector<uint32_t>			indices(keypoints.size());
+	uint32_t					i, numFeatures = 0;
+
+	if(!keypoints.empty()){
+		featureSet set = {&descriptors[0], &locations[0], &indices[0]};
+		describeFn describe = describers[hashBits - MIN_HASH_BITS];
+		numFeatures = (this->*describe)(input, keypoints, set, NULL);
+	}
+
+	features.resize(numFeatures);
+	for(i = 0; i < numFeatures; i++){
+		memcpy(features[i].descriptor, descriptors[i].bits, sizeof(Descriptor));
+		features[i].x	  = locations[i].x;
+		features[i].y	  = locations[i].y;
+		features[i].index = indices[i];
+	}
+}
+
+template<int BITS>
+uint32_t frameProcessor::describeFeatures(const Mat& input,
+										  const vector<KeyPoint>& keypoints,
+										  const featureSet& features, uint32_t* probes) const
+{
+	uint32_t			i, kpnt, numFeatures = 0;
+
 	uint8_t* data 	= (uint8_t*)input.data;
 	uint32_t step 	= input.step;
-	uint32_t width 	= input.cols;
-	uint32_t height = input.rows;
+	int width 		= input.cols;
+	int height 		= input.rows;
 
 	/**
 	 * compute BRIEF descriptor with index
@@ -171,12 +562,15 @@ void frameProcessor::extractFeatures(const Mat& input,
 		}
 
 	    /**
-	     * calculate 13-bit index for the patch
+	     * calculate BITS-bit index for the patch
 	     */
-		Feature feature;
-		feature.index	= calcHashIndex(input, keypoints[kpnt].pt);
-		feature.x 		= x;
-		feature.y 		= y;
+		uint32_t* featureProbes = probes ? probes + numFeatures*MAX_PROBES : NULL;
+		uint32_t* descriptor = features.descriptors[numFeatures].bits;
+		memset(descriptor, 0, sizeof(Descriptor));
+		features.indices[numFeatures]	  = hashIndex<BITS>(data, step, x, y, featureProbes);
+		features.locations[numFeatures].x = x;
+		features.locations[numFeatures].y = y;
+		numFeatures++;
 
 		/**
 		 * compute BRIEF descriptor for the patch
@@ -187,88 +581,125 @@ void frameProcessor::extractFeatures(const Mat& input,
 		                     <
 		                     data[(y + BRIEFLoc[i][3]) * width + x + BRIEFLoc[i][2]]);
 
-		    feature.descriptor[i / 32] |= test << (i & 31);
+		    descriptor[i / 32] |= test << (i & 31);
 		}
-		features.push_back(feature);
 	}
+	return numFeatures;
 }
 
-uint16_t frameProcessor::calcHashIndex(const Mat& input, const Point& pt) const
+uint32_t frameProcessor::calcHashIndex(const Mat& input, const Point& pt,
+									   uint32_t* probes, int hashBits) const
 {
-	uint8_t* 	data	= input.data;
-	uint32_t 	step	= input.step[0];
-	int 		xc		= pt.x;
-	int 		yc		= pt.y;
+	switch(hashBits){
+	case 10: return hashIndex<10>(input.data, input.step[0], pt.x, pt.y, probes);
+	case 11: return hashIndex<11>(input.data, input.step[0], pt.x, pt.y, probes);
+	case 12: return hashIndex<12>(input.data, input.step[0], pt.x, pt.y, probes);
+	case 13: return hashIndex<13>(input.data, input.step[0], pt.x, pt.y, probes);
+	case 14: return hashIndex<14>(input.data, input.step[0], pt.x, pt.y, probes);
+	case 15: return hashIndex<15>(input.data, input.step[0], pt.x, pt.y, probes);
+	case 16: return hashIndex<16>(input.data, input.step[0], pt.x, pt.y, probes);
+	case 17: return hashIndex<17>(input.data, input.step[0], pt.x, pt.y, probes);
+	default: return hashIndex<18>(input.data, input.step[0], pt.x, pt.y, probes);
+	}
+}
+
+template<int BITS>
+uint32_t frameProcessor::hashIndex(const uint8_t* data, uint32_t step, int xc, int yc,
+								   uint32_t* probes) const
+{
+	int			i, sample[BITS];
 
 	/* mean of patch */
-	int mean = (data[(yc-5)*step+(xc-5)] +
-				data[(yc-5)*step+(xc+5)] +
-				data[(yc-3)*step+(xc-1)] +
-				data[(yc-3)*step+(xc+1)] +
-				data[(yc-1)*step+(xc-3)] +
-				data[(yc-1)*step+(xc+3)] +
-				data[(yc)*step+(xc)] 	+
-				data[(yc+1)*step+(xc-3)] +
-				data[(yc+1)*step+(xc+3)] +
-				data[(yc+3)*step+(xc-1)] +
-				data[(yc+3)*step+(xc+1)] +
-				data[(yc+5)*step+(xc-5)] +
-				data[(yc+5)*step+(xc+5)]) / 13;
-
-	uint16_t index = 0;
-	index |= data[(yc-5)*step+(xc-5)] > mean ? 1<<12 : 0;
-	index |= data[(yc-5)*step+(xc+5)] > mean ? 1<<11 : 0;
-	index |= data[(yc-3)*step+(xc-1)] > mean ? 1<<10 : 0;
-	index |= data[(yc-3)*step+(xc+1)] > mean ? 1<<9  : 0;
-	index |= data[(yc-1)*step+(xc-3)] > mean ? 1<<8  : 0;
-	index |= data[(yc-1)*step+(xc+3)] > mean ? 1<<7  : 0;
-	index |= data[(yc)*step+(xc)]     > mean ? 1<<6  : 0;
-	index |= data[(yc+1)*step+(xc-3)] > mean ? 1<<5  : 0;
-	index |= data[(yc+1)*step+(xc+3)] > mean ? 1<<4  : 0;
-	index |= data[(yc+3)*step+(xc-1)] > mean ? 1<<3  : 0;
-	index |= data[(yc+3)*step+(xc+1)] > mean ? 1<<2  : 0;
-	index |= data[(yc+5)*step+(xc-5)] > mean ? 1<<1  : 0;
-	index |= data[(yc+5)*step+(xc+5)] > mean ? 1<<0  : 0;
+	int mean = 0;
+	for(i = 0; i < BITS; i++){
+		sample[i] = data[(yc+hashLoc[i][1])*step+(xc+hashLoc[i][0])];
+		mean += sample[i];
+	}
+	mean /= BITS;
+
+	uint32_t index = 0;
+	for(i = 0; i < BITS; i++){
+		index |= sample[i] > mean ? 1u<<(BITS-1-i) : 0;
+	}
+
+	if(probes){
+		/**
+		 * Multi-probe: the bits whose sample is closest to the mean are
+		 * the most likely to flip between model and query. Probe the
+		 * buckets obtained by flipping the least stable one, then the
+		 * second least stable one, as long as they are within
+		 * PROBE_MAX_MARGIN of the mean.
+		 */
+		int bit[MAX_PROBES], margin[MAX_PROBES];
+		int p;
+		for(p = 0; p < MAX_PROBES; p++){
+			bit[p]	  = -1;
+			margin[p] = PROBE_MAX_MARGIN + 1;
+		}
+		for(i = 0; i < BITS; i++){
+			int m = std::abs(sample[i] - mean);
+			for(p = 0; p < probeBudget; p++){
+				if(m < margin[p]){
+					for(int r = probeBudget - 1; r > p; r--){
+						bit[r]	  = bit[r-1];
+						margin[r] = margin[r-1];
+					}
+					bit[p]	  = BITS - 1 - i;
+					margin[p] = m;
+					break;
+				}
+			}
+		}
+		for(p = 0; p < MAX_PROBES; p++){
+			probes[p] = bit[p] >= 0 ? index ^ (1u<<bit[p]) : NO_PROBE;
+		}
+	}
 
 	return index;
 }
 
+/**
+* Sum up the statistics of one rhoRefC call
+*/
+void estimatorStats::add(const RHO_HEST_STATS& run, bool found)
+{
+	runs++;
+	accepted		+= found;
+	capped			+= run.numIterations >= RANSAC_MAX_ITER;
+	iterations		+= run.numIterations;
+	maxIterations	 = std::max(maxIterations, (uint64_t)run.numIterations);
+	degenerate		+= run.numDegenerate;
+	models			+= run.numModels;
+	sprtRejected	+= run.numSPRTRejected;
+	tested			+= run.numTested;
+	lmIterations	+= run.numLMIterations;
+	iterBound		+= run.maxIterBound;
+}
+
 /*
 * @return	return error code (0 if succeed).
 */
-int frameProcessor::estimateH(const std::vector<cv::Point2f>& srcPoints,
-		  	  	  	  	  	  const std::vector<cv::Point2f>& dstPoints)
+int frameProcessor::estimateH(const float* srcPoints, const float* dstPoints,
+							  unsigned npoints, float* H, uint32_t& numInliers)
 {
-	unsigned npoints = dstPoints.size();
 	if (npoints < MIN_NUM_MATCHES){
 		return RET_FAILED;
 	}
-
-	/**
-	 * Create temporary output matrix.
-	 * RHO outputs a single-precision H only.
-	 */
-	Mat tmpH = Mat(3, 3, CV_32FC1);
+	PROFILE_SCOPE(ZONE_ESTIMATE_H);
 
 	/**
 	 * Make use of the RHO estimator API.
 	 *
-	 * This is where the math happens. A homography estimation context is
-	 * initialized, used, then finalized.
+	 * This is where the math happens. The homography estimation context
+	 * is initialized once with the processor and reused for every frame,
+	 * so its buffers only grow when a frame brings more matches than any
+	 * frame before it.
 	 */
-
-	RHO_HEST_REFC* p = rhoRefCInit();
-
-	if(p == NULL){
+	if(rho == NULL){
 		return RET_FAILED;
 	}
 
-	/**
-	 * Optional. Ideally, the context would survive across calls to
-	 * findHomography(), but no clean way appears to exit to do so. The price
-	 * to pay is marginally more computational work than strictly needed.
-	 */
-	if(rhoRefCEnsureCapacity(p, npoints, (float)RANSAC_NR_BETA) != 1){
+	if(rhoRefCEnsureCapacity(rho, npoints, (float)RANSAC_NR_BETA) != 1){
 		return RET_FAILED;
 	}
 
@@ -277,15 +708,16 @@ int frameProcessor::estimateH(const std::vector<cv::Point2f>& srcPoints,
 	 *
 	 * Currently, NR (Non-Randomness criterion) and Final Refinement (with
 	 * internal, optimized Levenberg-Marquardt method) are enabled.
+	 *
+	 * RHO outputs a single-precision H only.
 	 */
-	Mat tempMask = Mat(npoints, 1, CV_8U);
+	char* tempMask = arena.alloc<char>(npoints);
 	unsigned minInliers = npoints * RANSAC_MIN_INL_RATIO;
 
-	LOG_E("rho 0\n");
-	int numInliers = rhoRefC(p,
-			(const float*)	&srcPoints[0],
-			(const float*)	&dstPoints[0],
-			(char*)			tempMask.data,
+	numInliers = rhoRefC(rho,
+			(const float*)	srcPoints,
+			(const float*)	dstPoints,
+			(char*)			tempMask,
 			(unsigned)		npoints,
 			(float)			RANSAC_REPROJ_THRSH,
 			(unsigned)		RANSAC_MAX_ITER,
@@ -295,19 +727,13 @@ int frameProcessor::estimateH(const std::vector<cv::Point2f>& srcPoints,
 			(double)		RANSAC_NR_BETA,
 			RHO_FLAG_ENABLE_NR | RHO_FLAG_ENABLE_FINAL_REFINEMENT,
 			NULL,
-			(float*)		tmpH.data);
-
-	/**
-     * Cleanup.
-     */
-    rhoRefCFini(p);
+			(float*)		H);
 
+	RHO_HEST_STATS run;
+	rhoRefCGetStats(rho, &run);
+	rhoStats.add(run, numInliers >= std::max(4U, (unsigned)minInliers));
 
-    /**
-     * Copy the result to homography.
-     */
     if(numInliers >= std::max(4U, (unsigned)minInliers)){
-    	homography = tmpH.clone();
     	return RET_SUCCESS;
     }
     else{
@@ -320,90 +746,177 @@ int frameProcessor::estimateH(const std::vector<cv::Point2f>& srcPoints,
 * given the computed Homography. It also checks if the bounding
 * region is a convex polygon.
 */
-int frameProcessor::drawTargetBox(Mat& src, const Scalar& color) const
+int frameProcessor::drawTargetBox(Mat& src, const targetDetection& detection,
+								  const Scalar& color) const
 {
 	/**
 	 * Compute output contours.
 	 */
-	 vector<Point2f> outCorners;
-	 if(trgCorners.size() != 4){
-		 LOG_E("Error: The model target corners are not initialized!");
-		 return RET_FAILED;
+	 const modelTarget& target = model->target(detection.target);
+	 const float* H = detection.H;
+	 Point contour[4];
+
+	 for(int i = 0; i < 4; i++){
+		 float x = target.corners[i].x, y = target.corners[i].y;
+		 float z = H[6]*x + H[7]*y + H[8];
+		 contour[i] = Point((H[0]*x + H[1]*y + H[2])/z, (H[3]*x + H[4]*y + H[5])/z);
 	 }
 
-	 cv::perspectiveTransform(trgCorners, outCorners, homography);
-
 	 /**
-	  * Draw located target to display.
+	  * Draw located target to display, if the quadrilateral is convex
+	  * (the cross products of consecutive edges share one sign). The
+	  * edges are drawn one by one: unlike isContourConvex and polylines,
+	  * this allocates nothing.
 	  */
+	 int numPositive = 0, numNegative = 0;
+	 for(int i = 0; i < 4; i++){
+		 Point a = contour[(i + 1) % 4] - contour[i];
+		 Point b = contour[(i + 2) % 4] - contour[(i + 1) % 4];
+		 int64_t cross = (int64_t)a.x*b.y - (int64_t)a.y*b.x;
+		 numPositive += cross > 0;
+		 numNegative += cross < 0;
+	 }
 
-	 if(outCorners.size() > 0 && isContourConvex(outCorners)){
-
-		 vector<vector<Point> > contours;
-		 vector<Point> contour;
-		 contour.push_back(Point((float)outCorners[0].x, (float)outCorners[0].y));
-		 contour.push_back(Point((float)outCorners[1].x, (float)outCorners[1].y));
-		 contour.push_back(Point((float)outCorners[2].x, (float)outCorners[2].y));
-		 contour.push_back(Point((float)outCorners[3].x, (float)outCorners[3].y));
-		 contours.push_back(contour);
-		 polylines(src, contours, true, color, 4);
+	 if(!numPositive != !numNegative){
+		 for(int i = 0; i < 4; i++){
+			 line(src, contour[i], contour[(i + 1) % 4], color, 4);
+		 }
 	 }
 
 	 return RET_SUCCESS;
 }
 
-//this reads the model from binary file
 int frameProcessor::loadModelFromFile(const string& filename)
 {
-	FILE * dFile = fopen(filename.c_str(), "rb");
-	if(!dFile){
+	std::shared_ptr<modelDatabase> next = std::make_shared<modelDatabase>();
+	if(next->addTargetFromFile(filename) < 0 || next->buildIndex() != RET_SUCCESS){
 		return RET_FAILED;
 	}
-	uint64_t len, actualRead, i;
+	setModel(next);
+	return RET_SUCCESS;
+}
 
-	//Read the image size
-	Size targetSize;
-	fread(&targetSize, 1, sizeof(Size), dFile);
+int frameProcessor::addModelFromFile(const string& filename)
+{
+	/**
+	 * Copy-on-write: the published snapshot is never modified. The lock
+	 * keeps two concurrent writers from losing each other's target.
+	 */
+	std::lock_guard<std::mutex> lock(publishLock);
+	std::shared_ptr<modelDatabase> next = std::make_shared<modelDatabase>(*published);
+	if(next->addTargetFromFile(filename) < 0 || next->buildIndex() != RET_SUCCESS){
+		return RET_FAILED;
+	}
+	publishModel(next);
+	return RET_SUCCESS;
+}
 
-	//Read Features
-	fread(&len,8,1,dFile);								// Read length in bytes
-	int numFeatures = (int)len/ (int)sizeof(Feature);	// Number of features
+void frameProcessor::setModel(const modelSnapshot& next)
+{
+	std::lock_guard<std::mutex> lock(publishLock);
+	publishModel(next);
+}
 
-	featureTable.resize(numFeatures);
+modelSnapshot frameProcessor::getModel(void) const
+{
+	std::lock_guard<std::mutex> lock(publishLock);
+	return published;
+}
 
-	actualRead = fread(&featureTable[0], sizeof(Feature), numFeatures, dFile);
+void frameProcessor::publishModel(const modelSnapshot& next)
+{
+	retired   = published;
+	published = next;
 
-	if(numFeatures != (int)actualRead){
-		LOG_E("Error: Could not read model completely! \n");
-		fclose(dFile);
-		return RET_FAILED;
+	// A snapshot still waiting to be picked up is superseded
+	delete pendingModel.exchange(new modelSnapshot(next));
+}
+
+int frameProcessor::loadModelFromFileAsync(const string& filename)
+{
+	/**
+	 * Only one load at a time, and the caller (the UI thread) never
+	 * waits for it: a running loader takes the request when its current
+	 * load is done. A loader that already found no request left has
+	 * exited or is about to, so joining it does not block.
+	 */
+	std::lock_guard<std::mutex> lock(loadLock);
+	loadRequest   = filename;
+	loadRequested = true;
+	loadStatus    = MODEL_LOADING;
+	if(!loaderRunning){
+		if(loader.joinable()){
+			loader.join();
+		}
+		loaderRunning = true;
+		loader = std::thread(&frameProcessor::loadRequestedModels, this);
 	}
+	return RET_SUCCESS;
+}
 
-	//Read feature index table
-	for(i = 0; i < 8192; i++){	// 8192 = (2^13) 13-bits index
+void frameProcessor::loadRequestedModels(void)
+{
+	std::unique_lock<std::mutex> lock(loadLock);
+	while(loadRequested){
+		string filename = loadRequest;
+		loadRequested = false;
+		lock.unlock();
+
+		std::shared_ptr<modelDatabase> next = std::make_shared<modelDatabase>();
+		bool loaded = next->addTargetFromFile(filename) >= 0 &&
+					  next->buildIndex() == RET_SUCCESS;
+		if(!loaded){
+			LOG_E("Error: Could not load model %s\n", filename.c_str());
+		}
 
-		fread(&len, 8, 1, dFile);
-		len /= (int)sizeof(uint32_t);
-		indexTbl[i].resize((int)len);
-		if(len){
-			actualRead = fread(&indexTbl[i][0], sizeof(uint32_t), (int)len, dFile);
-			if((int)len != (int)actualRead){
-				LOG_E("Error: Could not read the feature LUT completely!\n");
-				fclose(dFile);
-				return RET_FAILED;
+		/**
+		 * A model superseded by a newer request while it was built is
+		 * dropped, and the status is left to the newer request.
+		 */
+		lock.lock();
+		if(!loadRequested){
+			if(loaded){
+				setModel(next);
 			}
+			loadStatus = loaded ? MODEL_LOADED : MODEL_LOAD_FAILED;
 		}
 	}
+	loaderRunning = false;
+}
 
-	// Fill trgCorners with four corners of the model image
-	trgCorners.push_back(Point2f(0, targetSize.height));
-	trgCorners.push_back(Point2f(targetSize.width, targetSize.height));
-	trgCorners.push_back(Point2f(targetSize.width, 0));
-	trgCorners.push_back(Point2f(0, 0));
-	fclose(dFile);
-	return RET_SUCCESS;
+/**
+* Called by the frame thread only, once per frame: a single atomic
+* exchange when nothing changed. The old snapshot is still referenced
+* by "retired", so dropping it here does not free the model.
+*/
+void frameProcessor::installPendingModel(void)
+{
+	modelSnapshot* next = pendingModel.exchange(NULL);
+	if(next){
+		model.swap(*next);
+		delete next;
+	}
 }
 
+#define HASH_WIDTH_INSTANCES(fn) \
+		&frameProcessor::fn<10>, &frameProcessor::fn<11>, &frameProcessor::fn<12>, \
+		&frameProcessor::fn<13>, &frameProcessor::fn<14>, &frameProcessor::fn<15>, \
+		&frameProcessor::fn<16>, &frameProcessor::fn<17>, &frameProcessor::fn<18>
+
+const frameProcessor::describeFn frameProcessor::describers[MAX_HASH_BITS - MIN_HASH_BITS + 1] = {
+		HASH_WIDTH_INSTANCES(describeFeatures)
+};
+
+const frameProcessor::matchFn frameProcessor::bucketMatchers[MAX_HASH_BITS - MIN_HASH_BITS + 1] = {
+		HASH_WIDTH_INSTANCES(findBRIEFMatchesByBucket)
+};
+
+const int8_t frameProcessor::hashLoc[MAX_HASH_BITS][2] = {
+		{-5,-5},	{5,-5},		{-1,-3},	{1,-3},		{-3,-1},	{3,-1},		{0,0},
+		{-3,1},		{3,1},		{-1,3},		{1,3},		{-5,5},		{5,5},
+		{0,-5},		{-5,0},		{5,0},		{0,5},		{0,-1}
+};
+
 const int8_t frameProcessor::BRIEFLoc[256][4] = {
 		{0,0,-4,-2},        {7,-1,-3,1},        {3,-6,4,0},         {7,-11,-11,-3},     {-4,11,1,-8},   {9,-4,-14,-9},
 		{-8,0,8,4},         {-1,-3,10,2},       {7,-3,-5,6},        {0,-1,0,-2},        {6,2,0,6},      {-4,-3,-1,6},
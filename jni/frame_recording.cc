@@ -0,0 +1,374 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/frame_recording.h"
+
+namespace {
+
+// Chunk payloads are padded to 8 bytes
+inline size_t paddedSize(size_t size)
+{
+	return (size + 7) & ~(size_t)7;
+}
+
+bool isDirectory(const std::string& path)
+{
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+}  // namespace
+
+/**
+* Reader
+*/
+
+frameRecording::frameRecording() : frameWidth(0), frameHeight(0), cameraIntrinsics(NULL),
+								   mapping(NULL), mappingSize(0)
+{
+}
+
+frameRecording::~frameRecording()
+{
+	close();
+}
+
+void frameRecording::close(void)
+{
+	if(mapping){
+		munmap(mapping, mappingSize);
+	}
+	mapping			 = NULL;
+	mappingSize		 = 0;
+	cameraIntrinsics = NULL;
+	frameWidth		 = frameHeight = 0;
+	frames.clear();
+	timestamps.clear();
+	devicePoses.clear();
+	storage.clear();
+}
+
+int frameRecording::open(const std::string& path, uint32_t width, uint32_t height)
+{
+	close();
+	frameWidth	= width;
+	frameHeight	= height;
+	return isDirectory(path) ? openDirectory(path) : openFile(path);
+}
+
+int frameRecording::openFile(const std::string& filename)
+{
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	struct stat st;
+	if(fd < 0 || fstat(fd, &st) != 0){
+		LOG_E("Error: Could not open recording %s!\n", filename.c_str());
+		if(fd >= 0){
+			::close(fd);
+		}
+		return RET_FAILED;
+	}
+	mappingSize = st.st_size;
+	mapping = mappingSize ? mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	::close(fd);
+	if(mapping == MAP_FAILED){
+		mapping = NULL;
+	}
+
+	const uint8_t* pos = (const uint8_t*)mapping;
+	const uint8_t* end = pos + (mapping ? mappingSize : 0);
+	recordingHeader header = {0, 0, 0, 0};
+	if(end - pos >= (ptrdiff_t)sizeof(header)){
+		memcpy(&header, pos, sizeof(header));
+	}
+	if(header.magic != RECORDING_MAGIC || header.version != RECORDING_VERSION ||
+	   !header.width || !header.height){
+		LOG_E("Error: %s is not a frame recording!\n", filename.c_str());
+		close();
+		return RET_FAILED;
+	}
+	frameWidth	= header.width;
+	frameHeight	= header.height;
+	pos += sizeof(header);
+
+	/**
+	 * Walk the chunks; the last one may be truncated if the recorder
+	 * was not stopped cleanly.
+	 */
+	madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+	recordingChunk chunk;
+	while(end - pos >= (ptrdiff_t)sizeof(chunk)){
+		memcpy(&chunk, pos, sizeof(chunk));
+		pos += sizeof(chunk);
+		if((size_t)(end - pos) < chunk.size){
+			break;
+		}
+
+		switch(chunk.tag){
+		case CHUNK_FRAME:
+			if(chunk.size == sizeof(recordingFrame) + frameSize()){
+				timestamps.push_back(((const recordingFrame*)pos)->timestamp);
+				frames.push_back(pos + sizeof(recordingFrame));
+			}
+			break;
+		case CHUNK_POSE:
+			if(chunk.size == sizeof(recordingPose)){
+				devicePoses.push_back(*(const recordingPose*)pos);
+			}
+			break;
+		case CHUNK_INTRINSICS:
+			if(chunk.size == sizeof(recordingIntrinsics)){
+				cameraIntrinsics = (const recordingIntrinsics*)pos;
+			}
+			break;
+		default:
+			break;
+		}
+		pos += std::min(paddedSize(chunk.size), (size_t)(end - pos));
+	}
+	return RET_SUCCESS;
+}
+
+int frameRecording::openDirectory(const std::string& dirname)
+{
+	if(!frameWidth || !frameHeight){
+		LOG_E("Error: The frame size of raw NV21 files must be given!\n");
+		return RET_FAILED;
+	}
+
+	DIR* dir = opendir(dirname.c_str());
+	if(!dir){
+		LOG_E("Error: Could not open %s!\n", dirname.c_str());
+		return RET_FAILED;
+	}
+	std::vector<std::string> names;
+	struct dirent* entry;
+	while((entry = readdir(dir)) != NULL){
+		std::string name = entry->d_name;
+		if(name.size() > 5 && name.compare(name.size() - 5, 5, ".nv21") == 0){
+			names.push_back(name);
+		}
+	}
+	closedir(dir);
+	std::sort(names.begin(), names.end());
+
+	size_t size = frameSize();
+	storage.resize(names.size() * size);
+	for(size_t i = 0; i < names.size(); i++){
+		std::string filename = dirname + "/" + names[i];
+		FILE* dFile = fopen(filename.c_str(), "rb");
+		size_t actualRead = dFile ? fread(&storage[i * size], 1, size, dFile) : 0;
+		if(dFile){
+			fclose(dFile);
+		}
+		if(actualRead != size){
+			LOG_E("Error: %s is not a %ux%u NV21 frame!\n", filename.c_str(),
+				  frameWidth, frameHeight);
+			close();
+			return RET_FAILED;
+		}
+	}
+	for(size_t i = 0; i < names.size(); i++){
+		frames.push_back(&storage[i * size]);
+		timestamps.push_back(0.0);
+	}
+	return RET_SUCCESS;
+}
+
+/**
+* Writer
+*/
+
+frameRecorder::frameRecorder() : dFile(NULL), frameSize(0), frameHead(0), frameCount(0),
+								 poseHead(0), poseCount(0), stopping(false),
+								 recording(false), written(0), dropped(0)
+{
+}
+
+frameRecorder::~frameRecorder()
+{
+	stop();
+}
+
+int frameRecorder::start(const std::string& filename, uint32_t width, uint32_t height,
+						 const recordingIntrinsics* intrinsics, uint32_t numBuffers)
+{
+	stop();
+	if(!width || !height || !numBuffers){
+		return RET_FAILED;
+	}
+	dFile = fopen(filename.c_str(), "wb");
+	if(!dFile){
+		LOG_E("Error: Could not create recording %s!\n", filename.c_str());
+		return RET_FAILED;
+	}
+
+	recordingHeader header = {RECORDING_MAGIC, RECORDING_VERSION, width, height};
+	if(fwrite(&header, sizeof(header), 1, dFile) != 1 ||
+	   (intrinsics && writeChunk(CHUNK_INTRINSICS, intrinsics, sizeof(*intrinsics),
+								 NULL, 0) != RET_SUCCESS)){
+		LOG_E("Error: Could not write recording %s!\n", filename.c_str());
+		fclose(dFile);
+		dFile = NULL;
+		return RET_FAILED;
+	}
+
+	/**
+	 * Every buffer the camera thread will use is allocated here
+	 */
+	std::lock_guard<std::mutex> lock(queueLock);
+	frameSize = (size_t)width * height * 3 / 2;
+	buffers.resize(numBuffers * frameSize);
+	bufferTimestamps.resize(numBuffers);
+	freeBuffers.resize(numBuffers);
+	for(uint32_t i = 0; i < numBuffers; i++){
+		freeBuffers[i] = numBuffers - 1 - i;
+	}
+	frameQueue.resize(numBuffers);
+	poseQueue.resize(RECORDER_NUM_POSES);
+	frameHead = frameCount = 0;
+	poseHead  = poseCount  = 0;
+	stopping  = false;
+	written	  = 0;
+	dropped	  = 0;
+
+	recording = true;
+	writer = std::thread(&frameRecorder::run, this);
+	return RET_SUCCESS;
+}
+
+void frameRecorder::stop(void)
+{
+	if(!writer.joinable()){
+		return;
+	}
+	recording = false;
+	{
+		std::lock_guard<std::mutex> lock(queueLock);
+		stopping = true;
+	}
+	queueReady.notify_one();
+	writer.join();
+
+	fclose(dFile);
+	dFile = NULL;
+	LOG_I("Recording stopped: %u frames written, %u dropped\n",
+		  (uint32_t)written, (uint32_t)dropped);
+}
+
+int frameRecorder::addFrame(const uint8_t* nv21, double timestamp)
+{
+	if(!recording){
+		return RET_FAILED;
+	}
+
+	/**
+	 * The copy is done with the lock held, so that stop() and start()
+	 * never touch the buffers under it. The writer only takes the lock
+	 * between two chunks.
+	 */
+	{
+		std::lock_guard<std::mutex> lock(queueLock);
+		if(stopping){
+			return RET_FAILED;
+		}
+		if(freeBuffers.empty()){
+			dropped++;
+			return RET_FAILED;
+		}
+		uint32_t buffer = freeBuffers.back();
+		freeBuffers.pop_back();
+
+		memcpy(&buffers[buffer * frameSize], nv21, frameSize);
+		bufferTimestamps[buffer] = timestamp;
+		frameQueue[(frameHead + frameCount++) % frameQueue.size()] = buffer;
+	}
+	queueReady.notify_one();
+	return RET_SUCCESS;
+}
+
+int frameRecorder::addPose(const recordingPose& pose)
+{
+	if(!recording){
+		return RET_FAILED;
+	}
+	{
+		std::lock_guard<std::mutex> lock(queueLock);
+		if(stopping || poseCount == poseQueue.size()){
+			return RET_FAILED;
+		}
+		poseQueue[(poseHead + poseCount++) % poseQueue.size()] = pose;
+	}
+	queueReady.notify_one();
+	return RET_SUCCESS;
+}
+
+int frameRecorder::writeChunk(uint32_t tag, const void* head, uint32_t headSize,
+							  const void* data, uint32_t dataSize)
+{
+	static const uint8_t padding[8] = {0};
+	recordingChunk chunk = {tag, headSize + dataSize};
+	size_t pad = paddedSize(chunk.size) - chunk.size;
+
+	bool ok = fwrite(&chunk, sizeof(chunk), 1, dFile) == 1 &&
+			  fwrite(head, 1, headSize, dFile) == headSize &&
+			  (!dataSize || fwrite(data, 1, dataSize, dFile) == dataSize) &&
+			  (!pad || fwrite(padding, 1, pad, dFile) == pad);
+	return ok ? RET_SUCCESS : RET_FAILED;
+}
+
+void frameRecorder::run(void)
+{
+	for(;;){
+		recordingPose pose;
+		uint32_t buffer = 0;
+		bool havePose = false, haveFrame = false;
+		{
+			std::unique_lock<std::mutex> lock(queueLock);
+			queueReady.wait(lock, [this]{ return stopping || frameCount || poseCount; });
+			if(poseCount){
+				pose	 = poseQueue[poseHead];
+				poseHead = (poseHead + 1) % poseQueue.size();
+				poseCount--;
+				havePose = true;
+			}else if(frameCount){
+				buffer	  = frameQueue[frameHead];
+				frameHead = (frameHead + 1) % frameQueue.size();
+				frameCount--;
+				haveFrame = true;
+			}else{
+				break;	// Stopping with nothing left to write
+			}
+		}
+
+		/**
+		 * The disk is written without the lock held
+		 */
+		if(havePose){
+			writeChunk(CHUNK_POSE, &pose, sizeof(pose), NULL, 0);
+		}
+		if(haveFrame){
+			recordingFrame frame = {bufferTimestamps[buffer]};
+			if(writeChunk(CHUNK_FRAME, &frame, sizeof(frame),
+						  &buffers[buffer * frameSize], frameSize) == RET_SUCCESS){
+				written++;
+			}else{
+				dropped++;
+			}
+			std::lock_guard<std::mutex> lock(queueLock);
+			freeBuffers.push_back(buffer);
+		}
+	}
+	fflush(dFile);
+}
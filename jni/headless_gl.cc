@@ -0,0 +1,122 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#include <string.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/headless_gl.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA	0x31DD
+#endif
+
+namespace {
+
+// Surfaceless display if the client library has it, default display otherwise
+EGLDisplay openDisplay(void)
+{
+	const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+	if(extensions && strstr(extensions, "EGL_MESA_platform_surfaceless")){
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+				(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if(getPlatformDisplay){
+			EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+													EGL_DEFAULT_DISPLAY, NULL);
+			if(display != EGL_NO_DISPLAY){
+				return display;
+			}
+		}
+	}
+	return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+}  // namespace
+
+headlessGL::headlessGL() : display(EGL_NO_DISPLAY), surface(EGL_NO_SURFACE),
+						   context(EGL_NO_CONTEXT)
+{
+}
+
+headlessGL::~headlessGL()
+{
+	destroy();
+}
+
+int headlessGL::create(uint32_t width, uint32_t height)
+{
+	destroy();
+
+	display = openDisplay();
+	EGLint major, minor;
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)){
+		LOG_E("Error: Could not open an EGL display!\n");
+		display = EGL_NO_DISPLAY;
+		return RET_FAILED;
+	}
+
+	// Same framebuffer as the app's GLSurfaceView: RGB888 and a depth buffer
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 16,
+		EGL_NONE
+	};
+	const EGLint surfaceAttribs[] = {EGL_WIDTH, (EGLint)width, EGL_HEIGHT, (EGLint)height, EGL_NONE};
+	const EGLint contextAttribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if(!eglBindAPI(EGL_OPENGL_ES_API) ||
+	   !eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs < 1){
+		LOG_E("Error: No EGL pbuffer configuration with OpenGL ES 2!\n");
+		destroy();
+		return RET_FAILED;
+	}
+	surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+	if(surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+	   !eglMakeCurrent(display, surface, surface, context)){
+		LOG_E("Error: Could not create the EGL pbuffer context (0x%x)!\n", eglGetError());
+		destroy();
+		return RET_FAILED;
+	}
+	LOG_I("EGL %d.%d, %s\n", major, minor, renderer().c_str());
+	return RET_SUCCESS;
+}
+
+void headlessGL::destroy(void)
+{
+	if(display == EGL_NO_DISPLAY){
+		return;
+	}
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if(context != EGL_NO_CONTEXT){
+		eglDestroyContext(display, context);
+	}
+	if(surface != EGL_NO_SURFACE){
+		eglDestroySurface(display, surface);
+	}
+	eglTerminate(display);
+	display = EGL_NO_DISPLAY;
+	surface = EGL_NO_SURFACE;
+	context = EGL_NO_CONTEXT;
+}
+
+void headlessGL::swapBuffers(void)
+{
+	if(display != EGL_NO_DISPLAY){
+		eglSwapBuffers(display, surface);
+	}
+}
+
+std::string headlessGL::renderer(void) const
+{
+	const char* name = (const char*)glGetString(GL_RENDERER);
+	const char* version = (const char*)glGetString(GL_VERSION);
+	return std::string(name ? name : "?") + ", " + (version ? version : "?");
+}
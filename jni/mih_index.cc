@@ -0,0 +1,146 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#include <algorithm>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/mih_index.h"
+
+mihIndex::mihIndex() : m(0), keyBits(0), n(0)
+{
+}
+
+mihIndex::~mihIndex()
+{
+}
+
+void mihIndex::clear(void)
+{
+	m = keyBits = 0;
+	n = 0;
+	offsets.clear();
+	ids.clear();
+}
+
+void mihIndex::swap(mihIndex& other)
+{
+	std::swap(m, other.m);
+	std::swap(keyBits, other.keyBits);
+	std::swap(n, other.n);
+	offsets.swap(other.offsets);
+	ids.swap(other.ids);
+}
+
+inline uint32_t mihIndex::key(const uint32_t* descriptor, int s) const
+{
+	int bit = s * keyBits;
+	return (descriptor[bit >> 5] >> (bit & 31)) & ((1u << keyBits) - 1);
+}
+
+int mihIndex::build(const Descriptor* descriptors, uint32_t numFeatures, int numSubstrings)
+{
+	if(numSubstrings != 16 && numSubstrings != 32){
+		LOG_E("Error: MIH supports 16 or 32 substrings only!\n");
+		return RET_FAILED;
+	}
+	m		= numSubstrings;
+	keyBits	= DESCRIPTOR_LENGTH / m;
+	n		= numFeatures;
+
+	/**
+	 * One counting sort per substring table
+	 */
+	uint32_t numKeys = 1u << keyBits;
+	offsets.assign((size_t)m * (numKeys + 1), 0);
+	ids.resize((size_t)m * n);
+
+	for(int s = 0; s < m; s++){
+		uint32_t* offset = &offsets[(size_t)s * (numKeys + 1)];
+		uint32_t i;
+		for(i = 0; i < n; i++){
+			offset[key(descriptors[i].bits, s) + 1]++;
+		}
+		for(i = 0; i < numKeys; i++){
+			offset[i + 1] += offset[i];
+		}
+		for(i = 0; i < n; i++){
+			ids[(size_t)s * n + offset[key(descriptors[i].bits, s)]++] = i;
+		}
+		// The scatter above shifted every start to the next key's start
+		for(i = numKeys; i > 0; i--){
+			offset[i] = offset[i - 1];
+		}
+		offset[0] = 0;
+	}
+	return RET_SUCCESS;
+}
+
+int mihIndex::nearest(const uint32_t* descriptor, int radius, const Descriptor* descriptors,
+					  uint32_t* stamps, uint32_t stamp, uint32_t& nearestIdx,
+					  uint64_t& candidates, uint64_t& words) const
+{
+	int best = radius + 1;
+	if(!m){
+		return best;
+	}
+
+	/**
+	 * Substring radius: a match within "radius" has a substring within
+	 * radius / m bits of the query's.
+	 */
+	int flips = std::min(radius / m, keyBits);
+	uint32_t numKeys = 1u << keyBits;
+	int pos[DESCRIPTOR_LENGTH];
+
+	for(int s = 0; s < m; s++){
+		const uint32_t* offset = &offsets[(size_t)s * (numKeys + 1)];
+		const uint32_t* table  = &ids[(size_t)s * n];
+		uint32_t center = key(descriptor, s);
+
+		/**
+		 * Visit every key at 0, 1, ..., "flips" bits from the query key,
+		 * enumerating the flipped positions in lexicographic order.
+		 */
+		for(int d = 0; d <= flips; d++){
+			for(int i = 0; i < d; i++){
+				pos[i] = i;
+			}
+			for(;;){
+				uint32_t k = center;
+				for(int i = 0; i < d; i++){
+					k ^= 1u << pos[i];
+				}
+
+				for(uint32_t j = offset[k]; j < offset[k + 1]; j++){
+					uint32_t idx = table[j];
+					if(stamps[idx] == stamp){
+						continue;
+					}
+					stamps[idx] = stamp;
+					MATCH_STATS_ADD(candidates, 1);
+
+					int dist = descriptorDistance(descriptor, descriptors[idx].bits,
+												  best, words);
+					if(dist < best){
+						best	   = dist;
+						nearestIdx = idx;
+					}
+				}
+
+				int i = d - 1;
+				while(i >= 0 && pos[i] == keyBits - d + i){
+					i--;
+				}
+				if(i < 0){
+					break;
+				}
+				pos[i]++;
+				for(int j = i + 1; j < d; j++){
+					pos[j] = pos[j - 1] + 1;
+				}
+			}
+		}
+	}
+	return best;
+}
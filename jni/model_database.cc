@@ -0,0 +1,203 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/model_database.h"
+#include "tango-video-handler/model_file.h"
+
+using namespace cv;
+
+// Supported numbers of MIH substrings (0: no descriptor index)
+static bool validMIHSubstrings(int numSubstrings)
+{
+	return numSubstrings == 0 || numSubstrings == 16 || numSubstrings == 32;
+}
+
+/**
+* Bound a bucket to "maxLength" entries. The entries of a target are
+* appended together, so they form one run; the last entry of the longest
+* run (the newest target on ties) is dropped until the bucket fits,
+* leaving every target a fair share of it. A bucket of a single target
+* is kept whole.
+*/
+static void boundBucket(std::vector<uint32_t>& bucket, const std::vector<uint16_t>& targetTbl,
+						uint32_t maxLength)
+{
+	while(bucket.size() > maxLength){
+		size_t longestEnd = 0, longest = 0, runs = 0;
+		size_t start = 0;
+		for(size_t j = 1; j <= bucket.size(); j++){
+			if(j < bucket.size() && targetTbl[bucket[j]] == targetTbl[bucket[start]]){
+				continue;
+			}
+			if(j - start >= longest){
+				longest    = j - start;
+				longestEnd = j;
+			}
+			runs++;
+			start = j;
+		}
+		if(runs < 2){
+			return;
+		}
+		bucket.erase(bucket.begin() + longestEnd - 1);
+	}
+}
+
+modelDatabase::modelDatabase(int hashBits) : indexTbl((size_t)1 << hashBits),
+											  mihSubstrings(0)
+{
+}
+
+modelDatabase::~modelDatabase()
+{
+}
+
+void modelDatabase::clear(void)
+{
+	descriptorTbl.clear();
+	locationTbl.clear();
+	targetTbl.clear();
+	targets.clear();
+	for(size_t i = 0; i < indexTbl.size(); i++){
+		indexTbl[i].clear();
+	}
+	mihTbl.clear();
+}
+
+void modelDatabase::swap(modelDatabase& other)
+{
+	descriptorTbl.swap(other.descriptorTbl);
+	locationTbl.swap(other.locationTbl);
+	targetTbl.swap(other.targetTbl);
+	targets.swap(other.targets);
+	indexTbl.swap(other.indexTbl);
+	mihTbl.swap(other.mihTbl);
+	std::swap(mihSubstrings, other.mihSubstrings);
+}
+
+int modelDatabase::setMIHSubstrings(int numSubstrings)
+{
+	if(!validMIHSubstrings(numSubstrings)){
+		LOG_E("Error: MIH supports 16 or 32 substrings only!\n");
+		return RET_FAILED;
+	}
+	mihSubstrings = numSubstrings;
+	mihTbl.clear();
+	return buildIndex();
+}
+
+int modelDatabase::buildIndex(void)
+{
+	if(!mihSubstrings || !mihTbl.empty() || descriptorTbl.empty()){
+		return RET_SUCCESS;
+	}
+	return mihTbl.build(descriptorTbl.data(), descriptorTbl.size(), mihSubstrings);
+}
+
+int modelDatabase::addTarget(const Size& size, const std::vector<Feature>& features,
+							 const std::vector<std::vector<uint32_t> >& targetIndexTbl)
+{
+	if(targets.size() >= MAX_NUM_TARGETS){
+		LOG_E("Error: Too many targets in the model database!\n");
+		return RET_FAILED;
+	}
+
+	/**
+	 * All the targets share one index, so they must use the same hash
+	 * width. The first target sets it.
+	 */
+	int bits = ::hashBitsOf(targetIndexTbl.size());
+	if(bits < 0 || (bits != hashBits() && !targets.empty())){
+		LOG_E("Error: Model hash width does not match the database!\n");
+		return RET_FAILED;
+	}
+	if(bits != hashBits()){
+		indexTbl.assign(targetIndexTbl.size(), std::vector<uint32_t>());
+	}
+
+	uint32_t i, j;
+	uint32_t first = descriptorTbl.size();
+	uint16_t id    = targets.size();
+
+	/**
+	 * Append the features and re-base the bucket entries on the
+	 * shared feature table.
+	 */
+	for(i = 0; i < indexTbl.size(); i++){
+		const std::vector<uint32_t>& src = targetIndexTbl[i];
+		for(j = 0; j < src.size(); j++){
+			if(src[j] >= features.size()){
+				LOG_E("Error: Model index table points outside the feature table!\n");
+				return RET_FAILED;
+			}
+		}
+	}
+
+	descriptorTbl.resize(first + features.size());
+	locationTbl.resize(first + features.size());
+	for(i = 0; i < features.size(); i++){
+		memcpy(descriptorTbl[first + i].bits, features[i].descriptor, sizeof(Descriptor));
+		locationTbl[first + i].x = features[i].x;
+		locationTbl[first + i].y = features[i].y;
+	}
+	targetTbl.insert(targetTbl.end(), features.size(), id);
+
+	for(i = 0; i < indexTbl.size(); i++){
+		const std::vector<uint32_t>& src = targetIndexTbl[i];
+		for(j = 0; j < src.size(); j++){
+			indexTbl[i].push_back(first + src[j]);
+		}
+		if(id){
+			boundBucket(indexTbl[i], targetTbl, MAX_BUCKET_LENGTH);
+		}
+	}
+
+	// Fill corners with four corners of the model image
+	modelTarget target;
+	target.size			= size;
+	target.corners[0]	= Point2f(0, size.height);
+	target.corners[1]	= Point2f(size.width, size.height);
+	target.corners[2]	= Point2f(size.width, 0);
+	target.corners[3]	= Point2f(0, 0);
+	target.firstFeature	= first;
+	target.numFeatures	= features.size();
+	targets.push_back(target);
+
+	/**
+	 * The descriptor index no longer covers every feature. It is rebuilt
+	 * once by buildIndex() after the last target rather than per target.
+	 */
+	mihTbl.clear();
+
+	return id;
+}
+
+//this reads the model from binary file (raw or compressed)
+int modelDatabase::addTargetFromFile(const std::string& filename)
+{
+	Size targetSize;
+	std::vector<Feature> features;
+	std::vector<std::vector<uint32_t> > targetIndexTbl;
+	int numSubstrings = 0;
+
+	if(readModelFile(filename, targetSize, features, targetIndexTbl,
+					 &numSubstrings) != RET_SUCCESS){
+		return RET_FAILED;
+	}
+
+	/**
+	 * A model built with a descriptor index enables it for the whole
+	 * database
+	 */
+	if(numSubstrings && !mihSubstrings){
+		if(!validMIHSubstrings(numSubstrings)){
+			LOG_E("Error: MIH supports 16 or 32 substrings only!\n");
+			return RET_FAILED;
+		}
+		mihSubstrings = numSubstrings;
+	}
+	return addTarget(targetSize, features, targetIndexTbl);
+}
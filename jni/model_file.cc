@@ -0,0 +1,424 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <algorithm>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/model_file.h"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+using namespace cv;
+
+namespace {
+
+/**
+* Fixed part of a compressed model, followed by the descriptors
+* (numFeatures x 32 bytes), the locations (numFeatures x 2 uint16_t)
+* and three Stream VByte streams: feature indices (numFeatures), bucket
+* lengths (numBuckets) and bucket entries (numEntries, delta-coded
+* within each bucket). Optional (tag, value) pairs of uint32_t end
+* the file.
+*/
+struct compressedHeader {
+	uint32_t magic;
+	int32_t  width, height;
+	uint32_t numFeatures;
+	uint32_t numBuckets;
+	uint32_t numEntries;
+};
+
+/**
+* Shuffle masks of the vectorized decoder, one per control byte.
+* Mask byte 4k+b picks byte b of integer k in the data stream, or
+* zero (0xFF) past the length of that integer.
+*/
+struct streamVByteTables {
+	uint8_t shuffle[256][16];
+	uint8_t length[256];
+
+	streamVByteTables() {
+		for(int c = 0; c < 256; c++){
+			uint8_t offset = 0;
+			for(int k = 0; k < 4; k++){
+				int len = ((c >> (2 * k)) & 3) + 1;
+				for(int b = 0; b < 4; b++){
+					shuffle[c][4 * k + b] = b < len ? offset + b : 0xFF;
+				}
+				offset += len;
+			}
+			length[c] = offset;
+		}
+	}
+};
+
+const streamVByteTables svbTables;
+
+/**
+* Size of a Feature record of MODEL_RAW: descriptor, x, y (uint16_t)
+* and the hash index (uint32_t), without padding
+*/
+const size_t RAW_RECORD_SIZE = DESCRIPTOR_SIZE * sizeof(uint32_t) + 2 * sizeof(uint16_t) +
+							   sizeof(uint32_t);
+
+template<typename T>
+inline bool readValue(const uint8_t*& pos, const uint8_t* end, T& value)
+{
+	if(end - pos < (ptrdiff_t)sizeof(T)){
+		return false;
+	}
+	memcpy(&value, pos, sizeof(T));
+	pos += sizeof(T);
+	return true;
+}
+
+int readFile(const std::string& filename, std::vector<uint8_t>& buffer)
+{
+	FILE* dFile = fopen(filename.c_str(), "rb");
+	if(!dFile){
+		return RET_FAILED;
+	}
+	fseek(dFile, 0, SEEK_END);
+	long size = ftell(dFile);
+	fseek(dFile, 0, SEEK_SET);
+
+	buffer.resize(size > 0 ? size : 0);
+	size_t actualRead = size > 0 ? fread(&buffer[0], 1, size, dFile) : 0;
+	fclose(dFile);
+
+	return actualRead == buffer.size() ? RET_SUCCESS : RET_FAILED;
+}
+
+int parseRawModel(const uint8_t* pos, const uint8_t* end, Size& size,
+				  std::vector<Feature>& features,
+				  std::vector<std::vector<uint32_t> >& indexTbl)
+{
+	uint64_t len;
+
+	//Read the image size and features
+	if(!readValue(pos, end, size) || !readValue(pos, end, len) ||
+	   len > (uint64_t)(end - pos)){
+		LOG_E("Error: Could not read model completely! \n");
+		return RET_FAILED;
+	}
+	/**
+	 * Records are read field by field into the in-memory Feature
+	 */
+	features.resize(len / RAW_RECORD_SIZE);
+	const uint8_t* record = pos;
+	for(uint32_t i = 0; i < features.size(); i++){
+		uint16_t xy[2];
+		readValue(record, end, features[i].descriptor);
+		readValue(record, end, xy);
+		readValue(record, end, features[i].index);
+		features[i].x = xy[0];
+		features[i].y = xy[1];
+	}
+	pos += len;
+
+	//Read feature index table (always 13 bits in this format)
+	indexTbl.assign(INDEX_TABLE_SIZE, std::vector<uint32_t>());
+	for(uint32_t i = 0; i < INDEX_TABLE_SIZE; i++){
+		if(!readValue(pos, end, len) || len > (uint64_t)(end - pos)){
+			LOG_E("Error: Could not read the feature LUT completely!\n");
+			return RET_FAILED;
+		}
+		indexTbl[i].resize(len / sizeof(uint32_t));
+		if(!indexTbl[i].empty()){
+			memcpy(&indexTbl[i][0], pos, indexTbl[i].size() * sizeof(uint32_t));
+		}
+		pos += len;
+	}
+	return RET_SUCCESS;
+}
+
+int parseCompressedModel(const uint8_t* pos, const uint8_t* end, Size& size,
+						 std::vector<Feature>& features,
+						 std::vector<std::vector<uint32_t> >& indexTbl,
+						 int& mihSubstrings)
+{
+	compressedHeader header;
+	if(!readValue(pos, end, header) || hashBitsOf(header.numBuckets) < 0){
+		LOG_E("Error: Unsupported compressed model!\n");
+		return RET_FAILED;
+	}
+	indexTbl.assign(header.numBuckets, std::vector<uint32_t>());
+	uint32_t n = header.numFeatures;
+	size = Size(header.width, header.height);
+
+	/**
+	 * Descriptors and locations are stored as fixed-size arrays
+	 */
+	size_t fixedSize = (size_t)n * (sizeof(features[0].descriptor) + 2 * sizeof(uint16_t));
+	if((size_t)(end - pos) < fixedSize){
+		LOG_E("Error: Could not read model completely! \n");
+		return RET_FAILED;
+	}
+	features.resize(n);
+	for(uint32_t i = 0; i < n; i++){
+		memcpy(features[i].descriptor, pos, sizeof(features[i].descriptor));
+		pos += sizeof(features[i].descriptor);
+	}
+	for(uint32_t i = 0; i < n; i++){
+		uint16_t xy[2];
+		memcpy(xy, pos, sizeof(xy));
+		pos += sizeof(xy);
+		features[i].x = xy[0];
+		features[i].y = xy[1];
+	}
+
+	/**
+	 * Integer streams
+	 */
+	std::vector<uint32_t> values(std::max(n, std::max(header.numBuckets, header.numEntries)));
+	uint32_t* v = values.empty() ? NULL : &values[0];
+
+	if(!(pos = streamVByteDecode(pos, end, n, v))){
+		LOG_E("Error: Could not read model completely! \n");
+		return RET_FAILED;
+	}
+	for(uint32_t i = 0; i < n; i++){
+		features[i].index = v[i];
+	}
+
+	std::vector<uint32_t> lengths(header.numBuckets);
+	if(!(pos = streamVByteDecode(pos, end, header.numBuckets, &lengths[0])) ||
+	   !(pos = streamVByteDecode(pos, end, header.numEntries, v))){
+		LOG_E("Error: Could not read the feature LUT completely!\n");
+		return RET_FAILED;
+	}
+
+	/**
+	 * Undo the delta coding bucket by bucket
+	 */
+	uint32_t e = 0;
+	for(uint32_t i = 0; i < header.numBuckets; i++){
+		if(lengths[i] > header.numEntries - e){
+			LOG_E("Error: Could not read the feature LUT completely!\n");
+			return RET_FAILED;
+		}
+		std::vector<uint32_t>& bucket = indexTbl[i];
+		bucket.resize(lengths[i]);
+		uint32_t idx = 0;
+		for(uint32_t j = 0; j < lengths[i]; j++){
+			idx += v[e++];
+			bucket[j] = idx;
+		}
+	}
+
+	/**
+	 * Optional (tag, value) extensions; unknown tags are skipped
+	 */
+	uint32_t ext[2];
+	while(readValue(pos, end, ext)){
+		if(ext[0] == MODEL_EXT_MIH){
+			mihSubstrings = ext[1];
+		}
+	}
+	return RET_SUCCESS;
+}
+
+}  // namespace
+
+size_t streamVByteEncode(const uint32_t* in, uint32_t n, uint8_t* out)
+{
+	uint8_t* ctrl = out;
+	uint8_t* data = out + (n + 3) / 4;
+	memset(ctrl, 0, (n + 3) / 4);
+
+	for(uint32_t i = 0; i < n; i++){
+		uint32_t value = in[i];
+		int code = value < (1u << 8) ? 0 : value < (1u << 16) ? 1 : value < (1u << 24) ? 2 : 3;
+		ctrl[i >> 2] |= code << ((i & 3) * 2);
+		for(int b = 0; b <= code; b++){
+			*data++ = (uint8_t)(value >> (8 * b));
+		}
+	}
+	return data - out;
+}
+
+const uint8_t* streamVByteDecode(const uint8_t* in, const uint8_t* end,
+								 uint32_t n, uint32_t* out)
+{
+	const uint8_t* ctrl = in;
+	const uint8_t* data = in + (n + 3) / 4;
+	if(data > end){
+		return NULL;
+	}
+	uint32_t i = 0;
+
+	/**
+	 * Four integers per shuffle while 16 bytes can be loaded safely
+	 */
+#if defined(__SSSE3__)
+	for(; i + 4 <= n && end - data >= 16; i += 4){
+		uint8_t c = ctrl[i >> 2];
+		__m128i bytes = _mm_loadu_si128((const __m128i*)data);
+		__m128i mask  = _mm_loadu_si128((const __m128i*)svbTables.shuffle[c]);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_shuffle_epi8(bytes, mask));
+		data += svbTables.length[c];
+	}
+#elif defined(__aarch64__)
+	for(; i + 4 <= n && end - data >= 16; i += 4){
+		uint8_t c = ctrl[i >> 2];
+		uint8x16_t bytes = vld1q_u8(data);
+		vst1q_u8((uint8_t*)(out + i), vqtbl1q_u8(bytes, vld1q_u8(svbTables.shuffle[c])));
+		data += svbTables.length[c];
+	}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+	for(; i + 4 <= n && end - data >= 16; i += 4){
+		uint8_t c = ctrl[i >> 2];
+		uint8x8x2_t bytes = {{vld1_u8(data), vld1_u8(data + 8)}};
+		vst1_u8((uint8_t*)(out + i),     vtbl2_u8(bytes, vld1_u8(svbTables.shuffle[c])));
+		vst1_u8((uint8_t*)(out + i + 2), vtbl2_u8(bytes, vld1_u8(svbTables.shuffle[c] + 8)));
+		data += svbTables.length[c];
+	}
+#endif
+
+	for(; i < n; i++){
+		int len = ((ctrl[i >> 2] >> ((i & 3) * 2)) & 3) + 1;
+		if(end - data < len){
+			return NULL;
+		}
+		uint32_t value = 0;
+		for(int b = 0; b < len; b++){
+			value |= (uint32_t)data[b] << (8 * b);
+		}
+		out[i] = value;
+		data += len;
+	}
+	return data;
+}
+
+int readModelFile(const std::string& filename, Size& size,
+				  std::vector<Feature>& features,
+				  std::vector<std::vector<uint32_t> >& indexTbl,
+				  int* mihSubstrings)
+{
+	/**
+	 * The whole file is read at once and parsed in memory
+	 */
+	std::vector<uint8_t> buffer;
+	if(readFile(filename, buffer) != RET_SUCCESS){
+		return RET_FAILED;
+	}
+	const uint8_t* pos = buffer.empty() ? NULL : &buffer[0];
+	const uint8_t* end = pos + buffer.size();
+
+	uint32_t magic = 0;
+	if(buffer.size() >= sizeof(magic)){
+		memcpy(&magic, pos, sizeof(magic));
+	}
+	int numSubstrings = 0;
+	int ret = magic == MODEL_MAGIC ?
+			parseCompressedModel(pos, end, size, features, indexTbl, numSubstrings) :
+			parseRawModel(pos, end, size, features, indexTbl);
+	if(mihSubstrings){
+		*mihSubstrings = numSubstrings;
+	}
+	return ret;
+}
+
+int writeModelFile(const std::string& filename, const Size& size,
+				   const std::vector<Feature>& features,
+				   const std::vector<std::vector<uint32_t> >& indexTbl, modelFormat format,
+				   int mihSubstrings)
+{
+	std::vector<uint8_t> buffer;
+	uint32_t n = features.size();
+	uint32_t numBuckets = indexTbl.size();
+
+	if(hashBitsOf(numBuckets) < 0 ||
+	   (format == MODEL_RAW && (numBuckets != INDEX_TABLE_SIZE || mihSubstrings))){
+		LOG_E("Error: Hash width or index not supported by the model format!\n");
+		return RET_FAILED;
+	}
+
+	if(format == MODEL_RAW){
+		uint64_t len = n * RAW_RECORD_SIZE;
+		buffer.insert(buffer.end(), (const uint8_t*)&size, (const uint8_t*)(&size + 1));
+		buffer.insert(buffer.end(), (const uint8_t*)&len, (const uint8_t*)(&len + 1));
+		for(uint32_t i = 0; i < n; i++){
+			const Feature& f = features[i];
+			uint16_t xy[2] = {f.x, f.y};
+			buffer.insert(buffer.end(), (const uint8_t*)f.descriptor,
+						  (const uint8_t*)(f.descriptor + DESCRIPTOR_SIZE));
+			buffer.insert(buffer.end(), (const uint8_t*)xy, (const uint8_t*)(xy + 2));
+			buffer.insert(buffer.end(), (const uint8_t*)&f.index, (const uint8_t*)(&f.index + 1));
+		}
+		for(int i = 0; i < INDEX_TABLE_SIZE; i++){
+			len = indexTbl[i].size() * sizeof(uint32_t);
+			buffer.insert(buffer.end(), (const uint8_t*)&len, (const uint8_t*)(&len + 1));
+			if(len){
+				buffer.insert(buffer.end(), (const uint8_t*)&indexTbl[i][0],
+							  (const uint8_t*)(&indexTbl[i][0] + indexTbl[i].size()));
+			}
+		}
+	}else{
+		/**
+		 * Bucket lists are sorted so that they delta-code to small integers
+		 */
+		std::vector<uint32_t> lengths(numBuckets), entries, indices(n);
+		for(uint32_t i = 0; i < numBuckets; i++){
+			std::vector<uint32_t> bucket(indexTbl[i]);
+			std::sort(bucket.begin(), bucket.end());
+			lengths[i] = bucket.size();
+			for(size_t j = 0; j < bucket.size(); j++){
+				entries.push_back(j ? bucket[j] - bucket[j - 1] : bucket[j]);
+			}
+		}
+		for(uint32_t i = 0; i < n; i++){
+			indices[i] = features[i].index;
+		}
+
+		compressedHeader header;
+		header.magic		= MODEL_MAGIC;
+		header.width		= size.width;
+		header.height		= size.height;
+		header.numFeatures	= n;
+		header.numBuckets	= numBuckets;
+		header.numEntries	= entries.size();
+
+		buffer.resize(sizeof(header) + n * (sizeof(features[0].descriptor) + 2 * sizeof(uint16_t)) +
+					  streamVByteMaxSize(n) + streamVByteMaxSize(numBuckets) +
+					  streamVByteMaxSize(entries.size()));
+		uint8_t* pos = &buffer[0];
+
+		memcpy(pos, &header, sizeof(header));
+		pos += sizeof(header);
+		for(uint32_t i = 0; i < n; i++){
+			memcpy(pos, features[i].descriptor, sizeof(features[i].descriptor));
+			pos += sizeof(features[i].descriptor);
+		}
+		for(uint32_t i = 0; i < n; i++){
+			uint16_t xy[2] = {features[i].x, features[i].y};
+			memcpy(pos, xy, sizeof(xy));
+			pos += sizeof(xy);
+		}
+		pos += streamVByteEncode(n ? &indices[0] : NULL, n, pos);
+		pos += streamVByteEncode(&lengths[0], numBuckets, pos);
+		pos += streamVByteEncode(entries.empty() ? NULL : &entries[0], entries.size(), pos);
+		buffer.resize(pos - &buffer[0]);
+
+		if(mihSubstrings){
+			uint32_t ext[2] = {MODEL_EXT_MIH, (uint32_t)mihSubstrings};
+			buffer.insert(buffer.end(), (const uint8_t*)ext, (const uint8_t*)(ext + 2));
+		}
+	}
+
+	FILE* dFile = fopen(filename.c_str(), "wb");
+	if(!dFile){
+		return RET_FAILED;
+	}
+	size_t written = fwrite(&buffer[0], 1, buffer.size(), dFile);
+	int ret = (written != buffer.size() || ferror(dFile)) ? RET_FAILED : RET_SUCCESS;
+	fclose(dFile);
+	return ret;
+}
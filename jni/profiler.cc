@@ -0,0 +1,388 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/profiler.h"
+
+namespace {
+
+struct profileEvent {
+	uint32_t zone;
+	uint32_t frame;		// Frame id of the thread when recorded
+	uint64_t start;
+	uint64_t ns;
+};
+
+struct traceEvent {
+	profileEvent event;
+	int tid;
+};
+
+/**
+* Single-producer ring of one thread. Only the owner thread writes
+* events and advances "head"; the collector reads behind it and keeps
+* its own "tail".
+*/
+struct profileRing {
+	std::atomic<uint64_t> head;
+	uint64_t tail;
+	profileEvent events[PROFILE_RING_SIZE];
+	int tid;			// Kernel thread id of the owner
+	char name[32];		// Thread name in traces (may be empty)
+
+	profileRing() : head(0), tail(0), tid(0) { name[0] = 0; }
+};
+
+/**
+* Rings of every thread that recorded an event, the histograms and the
+* trace being recorded. Rings live as long as the process (a handful of
+* threads record).
+*/
+struct profileRegistry {
+	std::mutex lock;
+	std::vector<profileRing*> rings;
+	latencyHistogram histograms[NUM_PROFILE_ZONES];
+
+	std::atomic<bool> tracing;
+	std::vector<traceEvent> trace;
+	std::thread traceThread;
+	std::condition_variable traceStop;
+	uint32_t traceDropped;
+
+	profileRegistry() : tracing(false), traceDropped(0) {}
+};
+
+profileRegistry& registry(void)
+{
+	static profileRegistry instance;
+	return instance;
+}
+
+__thread profileRing* localRing = NULL;
+__thread uint32_t localFrame = 0;
+
+profileRing* registerRing(void)
+{
+	profileRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.lock);
+	localRing = new profileRing();
+	localRing->tid = syscall(__NR_gettid);
+	reg.rings.push_back(localRing);
+	return localRing;
+}
+
+// Drain one ring (registry lock held)
+void drainRing(profileRing* ring, profileRegistry& reg)
+{
+	uint64_t head = ring->head.load(std::memory_order_acquire);
+	uint64_t first = std::max(ring->tail, head > PROFILE_RING_SIZE ? head - PROFILE_RING_SIZE : 0);
+
+	static profileEvent copy[PROFILE_RING_SIZE];
+	uint64_t n = head - first, i;
+	for(i = 0; i < n; i++){
+		copy[i] = ring->events[(first + i) & (PROFILE_RING_SIZE - 1)];
+	}
+
+	/**
+	 * The owner kept writing while we copied: drop the events it may
+	 * have overwritten meanwhile. With head at "now", the slot of event
+	 * now - PROFILE_RING_SIZE may be half-written already, so only events
+	 * after it are kept. The fence keeps the copy ahead of the load.
+	 */
+	std::atomic_thread_fence(std::memory_order_acquire);
+	uint64_t now = ring->head.load(std::memory_order_relaxed);
+	uint64_t valid = now >= PROFILE_RING_SIZE ? now - PROFILE_RING_SIZE + 1 : 0;
+	for(i = 0; i < n; i++){
+		if(first + i < valid || copy[i].zone >= NUM_PROFILE_ZONES){
+			continue;
+		}
+		reg.histograms[copy[i].zone].add(copy[i].ns);
+		if(reg.tracing){
+			if(reg.trace.size() < PROFILE_MAX_TRACE_EVENTS){
+				traceEvent event = {copy[i], ring->tid};
+				reg.trace.push_back(event);
+			}else{
+				reg.traceDropped++;
+			}
+		}
+	}
+	ring->tail = head;
+}
+
+// Drain every ring (registry lock held)
+void drainRings(profileRegistry& reg)
+{
+	for(size_t i = 0; i < reg.rings.size(); i++){
+		drainRing(reg.rings[i], reg);
+	}
+}
+
+// Trace thread: drain the rings before they wrap
+void traceLoop(void)
+{
+	profileRegistry& reg = registry();
+	std::unique_lock<std::mutex> lock(reg.lock);
+	while(reg.tracing){
+		reg.traceStop.wait_for(lock, std::chrono::milliseconds(PROFILE_TRACE_PERIOD_MS));
+		drainRings(reg);
+	}
+}
+
+// Thread name as a JSON string body
+std::string jsonString(const char* text)
+{
+	std::string out;
+	for(; *text; text++){
+		if(*text == '"' || *text == '\\'){
+			out += '\\';
+		}
+		if((unsigned char)*text >= 0x20){
+			out += *text;
+		}
+	}
+	return out;
+}
+
+}  // namespace
+
+/**
+* Histogram
+*/
+
+void latencyHistogram::reset(void)
+{
+	memset(counts, 0, sizeof(counts));
+	count = sum = max = 0;
+	min = ~(uint64_t)0;
+}
+
+int latencyHistogram::bucketOf(uint64_t ns)
+{
+	if(ns < 16){
+		return ns;
+	}
+	int e = 63 - __builtin_clzll(ns);
+	int sub = (ns >> (e - PROFILE_HIST_SUB_BITS)) & ((1 << PROFILE_HIST_SUB_BITS) - 1);
+	return 16 + ((e - 4) << PROFILE_HIST_SUB_BITS) + sub;
+}
+
+uint64_t latencyHistogram::bucketUpperBound(int bucket)
+{
+	if(bucket < 16){
+		return bucket;
+	}
+	int e   = ((bucket - 16) >> PROFILE_HIST_SUB_BITS) + 4;
+	int sub = (bucket - 16) & ((1 << PROFILE_HIST_SUB_BITS) - 1);
+	uint64_t width = (uint64_t)1 << (e - PROFILE_HIST_SUB_BITS);
+	return (((uint64_t)(1 << PROFILE_HIST_SUB_BITS) + sub) * width) + width - 1;
+}
+
+void latencyHistogram::add(uint64_t ns)
+{
+	counts[bucketOf(ns)]++;
+	count++;
+	sum += ns;
+	min = std::min(min, ns);
+	max = std::max(max, ns);
+}
+
+uint64_t latencyHistogram::percentile(double p) const
+{
+	if(!count){
+		return 0;
+	}
+	uint64_t rank = std::max((uint64_t)1, (uint64_t)(p / 100.0 * count + 0.5));
+	uint64_t seen = 0;
+	for(int b = 0; b < PROFILE_HIST_BUCKETS; b++){
+		seen += counts[b];
+		if(seen >= rank){
+			return std::min(bucketUpperBound(b), max);
+		}
+	}
+	return max;
+}
+
+/**
+* Profiler
+*/
+
+void profiler::record(int zone, uint64_t start, uint64_t ns)
+{
+	profileRing* ring = localRing ? localRing : registerRing();
+	uint64_t head = ring->head.load(std::memory_order_relaxed);
+	profileEvent& event = ring->events[head & (PROFILE_RING_SIZE - 1)];
+	event.zone	= zone;
+	event.frame	= localFrame;
+	event.start	= start;
+	event.ns	= ns;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+void profiler::setFrameId(uint32_t frameId)
+{
+	localFrame = frameId;
+}
+
+void profiler::setThreadName(const char* name)
+{
+	profileRing* ring = localRing ? localRing : registerRing();
+	std::lock_guard<std::mutex> lock(registry().lock);
+	snprintf(ring->name, sizeof(ring->name), "%s", name);
+}
+
+void profiler::collect(void)
+{
+	profileRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.lock);
+	drainRings(reg);
+}
+
+void profiler::reset(void)
+{
+	profileRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.lock);
+	for(size_t i = 0; i < reg.rings.size(); i++){
+		reg.rings[i]->tail = reg.rings[i]->head.load(std::memory_order_acquire);
+	}
+	for(int z = 0; z < NUM_PROFILE_ZONES; z++){
+		reg.histograms[z].reset();
+	}
+}
+
+latencyHistogram profiler::histogram(int zone)
+{
+	profileRegistry& reg = registry();
+	std::lock_guard<std::mutex> lock(reg.lock);
+	return zone >= 0 && zone < NUM_PROFILE_ZONES ? reg.histograms[zone] : latencyHistogram();
+}
+
+std::string profiler::report(void)
+{
+	collect();
+
+	std::string text;
+	char line[160];
+	snprintf(line, sizeof(line), "%-14s %8s %9s %9s %9s %9s %9s\n", "zone", "count",
+			 "mean ms", "p50 ms", "p95 ms", "p99 ms", "max ms");
+	text += line;
+	for(int z = 0; z < NUM_PROFILE_ZONES; z++){
+		latencyHistogram h = histogram(z);
+		if(!h.count){
+			continue;
+		}
+		snprintf(line, sizeof(line), "%-14s %8llu %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+				 zoneName(z), (unsigned long long)h.count, h.mean() * 1e-6,
+				 h.percentile(50) * 1e-6, h.percentile(95) * 1e-6,
+				 h.percentile(99) * 1e-6, h.max * 1e-6);
+		text += line;
+	}
+	return text;
+}
+
+void profiler::startTrace(void)
+{
+	profileRegistry& reg = registry();
+	if(reg.traceThread.joinable()){
+		return;
+	}
+	{
+		// Events recorded so far are not part of the trace
+		std::lock_guard<std::mutex> lock(reg.lock);
+		drainRings(reg);
+		reg.trace.clear();
+		reg.traceDropped = 0;
+		reg.tracing		 = true;
+	}
+	reg.traceThread = std::thread(traceLoop);
+}
+
+bool profiler::tracing(void)
+{
+	return registry().tracing;
+}
+
+int profiler::stopTrace(const std::string& filename)
+{
+	profileRegistry& reg = registry();
+	if(!reg.traceThread.joinable()){
+		return RET_FAILED;
+	}
+	{
+		std::lock_guard<std::mutex> lock(reg.lock);
+		drainRings(reg);
+		reg.tracing = false;
+	}
+	reg.traceStop.notify_all();
+	reg.traceThread.join();
+
+	std::lock_guard<std::mutex> lock(reg.lock);
+	std::vector<traceEvent> trace;
+	trace.swap(reg.trace);
+	if(reg.traceDropped){
+		LOG_E("Warning: Trace full, %u events dropped!\n", reg.traceDropped);
+	}
+
+	FILE* dFile = fopen(filename.c_str(), "w");
+	if(!dFile){
+		LOG_E("Error: Could not create trace %s!\n", filename.c_str());
+		return RET_FAILED;
+	}
+
+	/**
+	 * Chrome trace format: a complete ("X") event per timed scope, in
+	 * microseconds from the first event, and the names of the threads
+	 */
+	int pid = getpid();
+	uint64_t origin = ~(uint64_t)0;
+	size_t i;
+	for(i = 0; i < trace.size(); i++){
+		origin = std::min(origin, trace[i].event.start);
+	}
+
+	const char* separator = "";
+	fprintf(dFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for(i = 0; i < reg.rings.size(); i++){
+		if(reg.rings[i]->name[0]){
+			fprintf(dFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+					"\"tid\":%d,\"args\":{\"name\":\"%s\"}}", separator, pid,
+					reg.rings[i]->tid, jsonString(reg.rings[i]->name).c_str());
+			separator = ",\n";
+		}
+	}
+	for(i = 0; i < trace.size(); i++){
+		const profileEvent& event = trace[i].event;
+		fprintf(dFile, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+				"\"pid\":%d,\"tid\":%d,\"args\":{\"frame\":%u}}", separator,
+				zoneName(event.zone), (event.start - origin) * 1e-3, event.ns * 1e-3,
+				pid, trace[i].tid, event.frame);
+		separator = ",\n";
+	}
+	fprintf(dFile, "\n]}\n");
+
+	bool ok = !ferror(dFile);
+	if(fclose(dFile) != 0 || !ok){
+		LOG_E("Error: Could not write trace %s!\n", filename.c_str());
+		return RET_FAILED;
+	}
+	return RET_SUCCESS;
+}
+
+const char* profiler::zoneName(int zone)
+{
+	static const char* const names[NUM_PROFILE_ZONES] = {
+		"pyramid", "fast", "brief", "match", "sort", "rho",
+		"processFrame", "estimateH", "yuvToRgb", "renderYUV",
+		"onFrameAvailable", "rhoRefC", "texUpload", "draw"
+	};
+	return zone >= 0 && zone < NUM_PROFILE_ZONES ? names[zone] : "?";
+}
@@ -48,6 +48,7 @@
 
 /* Includes */
 #include "tango-video-handler/param.h"
+#include "tango-video-handler/profiler.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -157,6 +158,15 @@ struct RHO_HEST_REFC{
         float*    Jte;             /* Jte vector */
     } lm;
 
+    /* Inlier masks, kept across runs */
+    struct{
+        char*     inl[2];          /* Current and best masks */
+        unsigned  size;            /* Capacity of each mask */
+    } mask;
+
+    /* Statistics of the last run */
+    RHO_HEST_STATS stats;
+
     /* Initialized? */
     int init;
 
@@ -308,6 +318,18 @@ void rhoRefCFini(RHO_HEST_REFC* p){
 }
 
 
+/**
+ * External access to the statistics of the last run.
+ *
+ * @param [in]  p      The initialized estimator context.
+ * @param [out] stats  The statistics of the last run.
+ */
+
+void rhoRefCGetStats(const RHO_HEST_REFC* p, RHO_HEST_STATS* stats){
+    *stats = p->stats;
+}
+
+
 /**
  * Estimates the homography using the given context, matches and parameters to
  * PROSAC.
@@ -351,6 +373,7 @@ unsigned rhoRefC(RHO_HEST_REFC* p,       /* Homography estimation context. */
                  unsigned       flags,   /* Works:       0 */
                  const float*   guessH,  /* Extrinsic guess, NULL if none provided */
                  float*         finalH){ /* Final result. */
+    PROFILE_SCOPE(ZONE_RHO_REFC);
     return p->rhoRefC(src, dst, inl, N, maxD, maxI, rConvg, cfd, minInl, beta,
                       flags, guessH, finalH);
 }
@@ -422,11 +445,13 @@ RHO_HEST_REFC::~RHO_HEST_REFC(){
  * Initialize the estimator context, by allocating the aligned buffers
  * internally needed.
  *
- * Currently there are 5 per-estimator buffers:
+ * Currently there are 7 per-estimator buffers:
  * - The buffer of m indexes representing a sample
  * - The buffer of 16 floats representing m matches (x,y) -> (X,Y).
  * - The buffer for the current homography
  * - The buffer for the best-so-far homography
+ * - The Levenberg-Marquardt workspace
+ * - Lazily, the two inlier masks (grown by initRun())
  * - Optionally, the non-randomness criterion table
  *
  * Returns 0 if unsuccessful and non-0 otherwise.
@@ -447,16 +472,23 @@ inline int    RHO_HEST_REFC::initialize(void){
     nr.size     = 0;
     nr.beta     = 0.0;
 
-    lm.ws       = NULL;
+    lm.ws       = (float*)   almalloc(2*8*8*sizeof(float) + 1*8*sizeof(float));
     lm.JtJ      = NULL;
     lm.tmp1     = NULL;
     lm.Jte      = NULL;
 
+    mask.inl[0] = NULL;
+    mask.inl[1] = NULL;
+    mask.size   = 0;
+
+    memset(&stats, 0, sizeof(stats));
+
 
     int areAllAllocsSuccessful = ctrl.smpl   &&
                                  curr.H      &&
                                  best.H      &&
-                                 curr.pkdPts;
+                                 curr.pkdPts &&
+                                 lm.ws;
 
     if(!areAllAllocsSuccessful){
         finalize();
@@ -471,7 +503,7 @@ inline int    RHO_HEST_REFC::initialize(void){
  * Finalize.
  *
  * Finalize the estimator context, by freeing the aligned buffers used
- * internally.
+ * internally and the non-randomness table.
  */
 
 inline void   RHO_HEST_REFC::finalize(void){
@@ -480,8 +512,22 @@ inline void   RHO_HEST_REFC::finalize(void){
         alfree(curr.H);
         alfree(best.H);
         alfree(curr.pkdPts);
+        alfree(lm.ws);
+        alfree(mask.inl[0]);
+        alfree(mask.inl[1]);
 
-        memset(this, 0, sizeof(*this));
+        std::vector<unsigned>().swap(nr.tbl);
+        nr.size = 0;
+        nr.beta = 0.0;
+
+        memset(&arg,   0, sizeof(arg));
+        memset(&ctrl,  0, sizeof(ctrl));
+        memset(&curr,  0, sizeof(curr));
+        memset(&best,  0, sizeof(best));
+        memset(&eval,  0, sizeof(eval));
+        memset(&lm,    0, sizeof(lm));
+        memset(&mask,  0, sizeof(mask));
+        memset(&stats, 0, sizeof(stats));
 
         init = 0;
     }
@@ -586,6 +632,7 @@ unsigned RHO_HEST_REFC::rhoRefC(const float*   src,     /* Source points */
     arg.flags   = flags;
     arg.guessH  = guessH;
     arg.finalH  = finalH;
+    memset(&stats, 0, sizeof(stats));
     if(!initRun()){
         outputZeroH();
         finiRun();
@@ -605,7 +652,11 @@ unsigned RHO_HEST_REFC::rhoRefC(const float*   src,     /* Source points */
      */
 
     for(ctrl.i=0; ctrl.i < arg.maxI || ctrl.i < 100; ctrl.i++){
-        hypothesize() && verify();
+        if(hypothesize()){
+            verify();
+        }else{
+            stats.numDegenerate++;
+        }
     }
 
 
@@ -619,6 +670,14 @@ unsigned RHO_HEST_REFC::rhoRefC(const float*   src,     /* Source points */
 
     outputModel();
     finiRun();
+
+    stats.numIterations   = ctrl.i;
+    stats.numModels       = ctrl.numModels;
+    stats.numTested       = eval.Ntestedtotal;
+    stats.maxIterBound    = arg.maxI;
+    stats.phNum           = ctrl.phNum;
+    stats.numInliers      = best.numInl;
+
     return isBestModelGoodEnough() ? best.numInl : 0;
 }
 
@@ -690,12 +749,22 @@ inline int    RHO_HEST_REFC::initRun(void){
      * Runs second because we want to quit as fast as possible if we can't even
      * allocate the up tp two masks.
      *
-     * If the calling software wants an output mask, use buffer provided. If
-     * not, allocate one anyways internally.
+     * The masks are kept in the context and only reallocated when a run
+     * brings more matches than any run before it. If the calling software
+     * wants an output mask, use buffer provided. If not, use the second
+     * internal one.
      */
 
-    best.inl = arg.inl ? arg.inl : (char*)almalloc(arg.N);
-    curr.inl = (char*)almalloc(arg.N);
+    if(arg.N > mask.size){
+        alfree(mask.inl[0]);
+        alfree(mask.inl[1]);
+        mask.inl[0] = (char*)almalloc(arg.N);
+        mask.inl[1] = (char*)almalloc(arg.N);
+        mask.size   = (mask.inl[0] && mask.inl[1]) ? arg.N : 0;
+    }
+
+    best.inl = arg.inl ? arg.inl : mask.inl[1];
+    curr.inl = mask.inl[0];
 
     if(!curr.inl || !best.inl){
         return 0;
@@ -705,24 +774,14 @@ inline int    RHO_HEST_REFC::initRun(void){
     memset(curr.inl, 0, arg.N);
 
     /**
-     * LevMarq workspace alloc.
+     * LevMarq workspace setup.
      *
-     * Runs third, consists only in a few conditional mallocs. If malloc fails
-     * we wish to quit before doing any serious work.
+     * Runs third. The workspace itself is allocated once by initialize().
      */
 
-    if(isRefineEnabled() || isFinalRefineEnabled()){
-        lm.ws   = (float*)almalloc(2*8*8*sizeof(float) + 1*8*sizeof(float));
-        if(!lm.ws){
-            return 0;
-        }
-
-        lm.JtJ  = (float(*)[8])(lm.ws + 0*8*8);
-        lm.tmp1 = (float(*)[8])(lm.ws + 1*8*8);
-        lm.Jte  = (float*)     (lm.ws + 2*8*8);
-    }else{
-        lm.ws = NULL;
-    }
+    lm.JtJ  = (float(*)[8])(lm.ws + 0*8*8);
+    lm.tmp1 = (float(*)[8])(lm.ws + 1*8*8);
+    lm.Jte  = (float*)     (lm.ws + 2*8*8);
 
     /**
      * Reset scalar per-run state.
@@ -764,40 +823,16 @@ inline int    RHO_HEST_REFC::initRun(void){
 /**
  * Finalize SAC run.
  *
- * Deallocates per-run allocatable resources. Currently this consists only of
- * the best and current inlier masks, which are equal in size to p->arg.N
- * bytes.
+ * Detaches the per-run inlier masks. The masks themselves, as well as the
+ * Levenberg-Marquardt workspace, belong to the context and are reused by
+ * the next run.
  *
- * Reads:  arg.bestInl, curr.inl, best.inl
  * Writes: curr.inl, best.inl
  */
 
 inline void   RHO_HEST_REFC::finiRun(void){
-    /**
-     * If no output inlier mask was required, free both (internal) masks.
-     * Else if an (external) mask was provided as argument, find the other
-     * (the internal one) and free it.
-     */
-    if(arg.inl){
-        if(arg.inl == best.inl){
-            alfree(curr.inl);
-        }else{
-            alfree(best.inl);
-        }
-    }else{
-        alfree(best.inl);
-        alfree(curr.inl);
-    }
-
     best.inl = NULL;
     curr.inl = NULL;
-
-    /**
-     * ₣ree the Levenberg-Marquardt workspace.
-     */
-
-    alfree(lm.ws);
-    lm.ws = NULL;
 }
 
 /**
@@ -1129,6 +1164,7 @@ inline void   RHO_HEST_REFC::evaluateModelSPRT(void){
 
     eval.Ntested       = i;
     eval.Ntestedtotal += i;
+    stats.numSPRTRejected += !eval.good;
 }
 
 /**
@@ -1301,8 +1337,6 @@ static inline void   sacInitNonRand(double    beta,
  */
 
 inline void   RHO_HEST_REFC::nStarOptimize(void){
-
-	LOG_E("start\n");
     unsigned min_sample_length = 10*2; /*(N * INLIERS_RATIO) */
     unsigned best_n       = arg.N;
     unsigned test_n       = best_n;
@@ -1328,7 +1362,6 @@ inline void   RHO_HEST_REFC::nStarOptimize(void){
                                             SMPL_SIZE,
                                             arg.maxI);
     }
-    LOG_E("end\n");
 }
 
 /**
@@ -1794,6 +1827,8 @@ inline void   RHO_HEST_REFC::refine(void){
 
     /*Levenberg-Marquardt Loop.*/
     for(i=0;i<MAXLEVMARQITERS;i++){
+        stats.numLMIterations++;
+
         /**
          * Attempt a step given current state
          *   - Jacobian-x-Jacobian   (JtJ)
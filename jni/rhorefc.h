@@ -83,6 +83,23 @@ struct RHO_HEST_REFC;
 typedef struct RHO_HEST_REFC RHO_HEST_REFC;
 
 
+/**
+ * Statistics of the last estimation run with a context.
+ */
+
+typedef struct RHO_HEST_STATS{
+    unsigned numIterations;   /* PROSAC iterations run */
+    unsigned numDegenerate;   /* Samples or models rejected as degenerate */
+    unsigned numModels;       /* Models evaluated (including the guess) */
+    unsigned numSPRTRejected; /* Models rejected early by SPRT */
+    unsigned numTested;       /* Points tested, over all evaluations */
+    unsigned numLMIterations; /* Levenberg-Marquardt iterations */
+    unsigned maxIterBound;    /* Final iteration bound (maxI after updates) */
+    unsigned phNum;           /* Final PROSAC phase (matches sampled from) */
+    unsigned numInliers;      /* Inliers of the best model, accepted or not */
+} RHO_HEST_STATS;
+
+
 /* Functions */
 
 /**
@@ -125,6 +142,22 @@ int  rhoRefCEnsureCapacity(RHO_HEST_REFC* p, unsigned N, double beta);
 void rhoRefCFini(RHO_HEST_REFC* p);
 
 
+/**
+ * Get the statistics of the last call to rhoRefC() with the given context.
+ * All are zero if no call was made, or if the last one was rejected for
+ * invalid arguments.
+ *
+ * The iteration counts and the final iteration bound are meant for tuning
+ * the maximum number of iterations and the confidence; the SPRT rejections
+ * and the number of points tested show how much the early exit saves.
+ *
+ * @param [in]  p      The initialized estimator context.
+ * @param [out] stats  The statistics of the last run. Cannot be NULL.
+ */
+
+void rhoRefCGetStats(const RHO_HEST_REFC* p, RHO_HEST_STATS* stats);
+
+
 /**
  * Estimates the homography using the given context, matches and parameters to
  * PROSAC.
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#ifndef FEATURE_H_
+#define FEATURE_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define DESCRIPTOR_LENGTH 	256		// Length of BRIEF descriptor in bits
+#define DESCRIPTOR_SIZE		8		// Size of the descriptor (256/32 = 8)
+#define MIN_HASH_BITS		10		// Supported widths of the patch hash index
+#define MAX_HASH_BITS		18
+#define DEFAULT_HASH_BITS	13
+#define INDEX_TABLE_SIZE	(1 << DEFAULT_HASH_BITS)	// 8192 buckets of a 13-bit index
+
+#define DESCRIPTOR_ALIGN	32		// Alignment of descriptor arrays (one 256-bit vector)
+
+/**
+* Descriptor comparison counters of the matchers (matchStats). They are
+* compiled in with the profiler (TANGO_PROFILE) unless TANGO_MATCH_STATS
+* is set otherwise; with TANGO_MATCH_STATS=0 the counters stay at zero.
+*/
+#ifndef TANGO_MATCH_STATS
+#if defined(TANGO_PROFILE)
+#define TANGO_MATCH_STATS	TANGO_PROFILE
+#else
+#define TANGO_MATCH_STATS	1
+#endif
+#endif
+
+#if TANGO_MATCH_STATS
+#define MATCH_STATS_ADD(counter, n)	((counter) += (n))
+#else
+#define MATCH_STATS_ADD(counter, n)	((void)0)
+#endif
+
+/**
+* Struct for holding feature points
+*
+* This is the interchange record of the model files and of the tools.
+* The matcher keeps descriptors and locations in separate arrays
+* instead (see featureSet), so that a matching pass only streams the
+* 32-byte descriptors through the cache. Copies are member-wise (the
+* struct is trivially copyable).
+*/
+struct Feature {
+	uint32_t descriptor[DESCRIPTOR_SIZE];
+	unsigned short x, y; 	// feature location
+	uint32_t index;			// feature index id
+
+	Feature(): x(0), y(0), index(0) {
+		memset(descriptor, 0, sizeof(descriptor));
+	}
+};
+
+/**
+* BRIEF descriptor, aligned for vector loads
+*/
+struct __attribute__((aligned(DESCRIPTOR_ALIGN))) Descriptor {
+	uint32_t bits[DESCRIPTOR_SIZE];
+};
+
+/**
+* Packed feature location
+*/
+struct featureLocation {
+	uint16_t x, y;
+};
+
+/**
+* Structure-of-arrays view of n features: descriptors, locations and
+* hash indices of feature i are descriptors[i], locations[i], indices[i].
+*/
+struct featureSet {
+	Descriptor*			descriptors;
+	featureLocation*	locations;
+	uint32_t*			indices;
+};
+
+/**
+* Allocator for std::vector of over-aligned types (the default one only
+* guarantees the alignment of malloc)
+*/
+template<typename T, size_t Align = DESCRIPTOR_ALIGN>
+struct alignedAllocator {
+	typedef T value_type;
+	template<typename U> struct rebind { typedef alignedAllocator<U, Align> other; };
+
+	alignedAllocator() {}
+	template<typename U> alignedAllocator(const alignedAllocator<U, Align>&) {}
+
+	T* allocate(size_t n) {
+		void* p = NULL;
+		if (posix_memalign(&p, Align, n * sizeof(T)) != 0) {
+			abort();	// As std::allocator does without exceptions
+		}
+		return static_cast<T*>(p);
+	}
+	void deallocate(T* p, size_t) { free(p); }
+
+	template<typename U> bool operator ==(const alignedAllocator<U, Align>&) const { return true; }
+	template<typename U> bool operator !=(const alignedAllocator<U, Align>&) const { return false; }
+};
+
+// Descriptor array of 32-byte aligned storage
+typedef std::vector<Descriptor, alignedAllocator<Descriptor> > descriptorArray;
+
+/**
+* Hash width of an index table with "numBuckets" buckets, or -1 if it
+* is not a power of two between 2^MIN_HASH_BITS and 2^MAX_HASH_BITS.
+*/
+static inline int hashBitsOf(size_t numBuckets) {
+	for (int bits = MIN_HASH_BITS; bits <= MAX_HASH_BITS; bits++) {
+		if (numBuckets == ((size_t)1 << bits)) {
+			return bits;
+		}
+	}
+	return -1;
+}
+
+static inline int int32BitCount(unsigned v) {
+    // http://www-graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    return (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;	// count
+}
+
+static inline int descriptorBitCount(unsigned* desc) {
+    int dword_count = DESCRIPTOR_SIZE;
+    int i, bitCount = 0;
+    for (i = 0; i < dword_count; i++){
+    	bitCount += int32BitCount(desc[i]);
+    }
+    return bitCount;
+}
+
+/**
+* Hamming distance between two descriptors with early exit.
+*
+* The partial distance is checked after 64 and 128 bits; as soon as it
+* reaches "bound" the candidate cannot beat the current best match and the
+* partial distance (>= bound) is returned. The number of 32-bit words
+* compared is added to "words" (with TANGO_MATCH_STATS only).
+*/
+static inline int descriptorDistance(const uint32_t* a, const uint32_t* b,
+									 int bound, uint64_t& words) {
+	int dist = int32BitCount(a[0] ^ b[0]) + int32BitCount(a[1] ^ b[1]);
+	if (dist >= bound) {
+		MATCH_STATS_ADD(words, 2);
+		return dist;
+	}
+	dist += int32BitCount(a[2] ^ b[2]) + int32BitCount(a[3] ^ b[3]);
+	if (dist >= bound) {
+		MATCH_STATS_ADD(words, 4);
+		return dist;
+	}
+	dist += int32BitCount(a[4] ^ b[4]) + int32BitCount(a[5] ^ b[5]) +
+			int32BitCount(a[6] ^ b[6]) + int32BitCount(a[7] ^ b[7]);
+	MATCH_STATS_ADD(words, DESCRIPTOR_SIZE);
+	return dist;
+}
+
+#endif  // FEATURE_H_
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#ifndef FRAME_ARENA_H_
+#define FRAME_ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define ARENA_ALIGN			32		// Default alignment of arena blocks
+#define ARENA_INIT_SIZE		(256*1024)	// Initial arena size in bytes
+
+/**
+* Per-frame bump allocator.
+*
+* Memory returned by alloc() stays valid until the next reset(). Requests
+* that do not fit in the current block are served from the heap and
+* the block is grown at the next reset() to the high-water mark of the
+* previous frame, so that after warm-up a frame never touches the heap.
+*/
+class frameArena {
+public:
+
+	// Constructor and deconstructor.
+	frameArena(size_t initSize = ARENA_INIT_SIZE);
+	~frameArena();
+
+	// Start a new frame. Invalidates everything allocated so far.
+	void reset(void);
+
+	// Allocate an uninitialized block of bytes
+	void* alloc(size_t bytes, size_t align = ARENA_ALIGN);
+
+	// Allocate an uninitialized array of n elements of type T
+	template<typename T>
+	T* alloc(size_t n) {
+		return static_cast<T*>(alloc(n * sizeof(T)));
+	}
+
+	// Number of bytes handed out since the last reset
+	size_t used(void) const { return offset + overflowBytes; }
+
+	// Size of the backing block
+	size_t capacity(void) const { return size; }
+
+private:
+	// Forbid copying
+	frameArena(const frameArena&);
+	frameArena& operator =(const frameArena&);
+
+	void releaseOverflow(void);
+
+	uint8_t*			block;		// Backing block
+	size_t				size;		// Size of the backing block
+	size_t				offset;		// Bump pointer
+	size_t				overflowBytes;	// Bytes served from the heap this frame
+	std::vector<void*>	overflow;	// Heap blocks served this frame
+};
+
+#endif  // FRAME_ARENA_H_
@@ -6,60 +6,130 @@
 #ifndef FRAME_PROCESSOR_H_
 #define FRAME_PROCESSOR_H_
 
-#include <jni.h>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/features2d/features2d.hpp>
 #include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
 #include "rhorefc.h"
+#include "frame_arena.h"
+#include "feature.h"
+#include "model_database.h"
 
-#define DESCRIPTOR_LENGTH 	256		// Length of BRIEF descriptor in bits
-#define DESCRIPTOR_SIZE		8		// Size of the descriptor (256/32 = 8)
 #define MAX_TOTAL_MATCH		1000	// Maximum number of required matches
 #define FAST_THRSH			30		// FAST9 threshold (smaller -> more features)
+#define MAX_FRAME_KEYPOINTS	8192	// Keypoints reserved per pyramid level
 #define HALF_PATCH_WIDTH	15		// Half of 30 patch used in BRIEF
 #define MIN_HAMMING_DIST	46		// Hamming threshold used for matching
+#define MAX_PROBES			2		// Maximum number of extra buckets per query
+#define NO_PROBE			0xFFFFFFFF	// Unused probe slot
+#define PROBE_MAX_MARGIN	10		// Only bits this close to the mean are probed
 using namespace cv;
 
+/**
+* Order in which runtime features are matched against the model
+*/
+enum matchMode {
+	MATCH_BY_FEATURE = 0,	// one bucket lookup per query feature
+	MATCH_BY_BUCKET  = 1	// queries grouped by bucket, each bucket read once
+};
+
 /**
 * Struct similar to OpenCV DMatch
-* for holding matching pair
+* for holding matching pair. The matched locations are stored
+* in place so that sorting needs no index indirection.
 */
 typedef struct	d_match  D_MATCH;
 struct	d_match {
-    uint32_t queryIdx; // query descriptor index
-    uint32_t trainIdx; // train descriptor index
+    float    src[2];   // query location (full-scale frame coordinates)
+    float    dst[2];   // train location (model coordinates)
     uint16_t distance; // matching distance
+    uint16_t target;   // target id of the train feature
+};
 
-    /* compare operator */
-    bool operator < (const D_MATCH &m) const{
-    	return distance < m.distance;
-    }
+/**
+* State of the last background model load (loadModelFromFileAsync)
+*/
+enum modelLoadStatus {
+	MODEL_LOAD_NONE = 0,	// no background load requested
+	MODEL_LOADING,			// a load is running or queued
+	MODEL_LOADED,			// the last requested model is in use
+	MODEL_LOAD_FAILED		// the last requested model could not be read
 };
 
 /**
-* Struct for holding feature points
+* A target located in the query frame
 */
-struct Feature {
-	uint32_t descriptor[DESCRIPTOR_SIZE];
-	unsigned short x, y; 	// feature location
-	uint32_t index;			// feature index id
+struct targetDetection {
+	uint16_t target;		// target id in the model database
+	uint32_t numInliers;	// RHO inliers supporting H
+	float    H[9];			// homography from target to frame (H22 = 1)
+};
 
-	Feature(): index(0), x(0), y(0) {
-		memset(descriptor, 0, sizeof(descriptor));
-	}
-	Feature(const Feature& obj) : index(obj.index), x(obj.x), y(obj.y){
-		if(obj.descriptor != NULL)
-			memcpy(descriptor, obj.descriptor, sizeof(descriptor));
-	}
-	Feature& operator =(const Feature& obj){
-		x = obj.x;
-		y = obj.y;
-		index = obj.index;
-		if(obj.descriptor != NULL)
-			memcpy(descriptor, obj.descriptor, sizeof(descriptor));
-	}
+/**
+* Counters of the descriptor comparisons done while matching (zero if
+* built with TANGO_MATCH_STATS=0, see feature.h)
+*/
+struct matchStats {
+	uint64_t candidates;	// descriptor pairs compared
+	uint64_t words;			// 32-bit descriptor words touched
+
+	matchStats(): candidates(0), words(0) {}
+};
+
+/**
+* Homography estimation counters, summed over the rhoRefC calls (see
+* RHO_HEST_STATS), to tune the RANSAC_* parameters
+*/
+struct estimatorStats {
+	uint64_t runs;			// rhoRefC calls
+	uint64_t accepted;		// calls returning a homography
+	uint64_t capped;		// calls that ran RANSAC_MAX_ITER iterations
+	uint64_t iterations;	// PROSAC iterations
+	uint64_t maxIterations;	// most iterations of one call
+	uint64_t degenerate;	// samples and models rejected as degenerate
+	uint64_t models;		// models evaluated
+	uint64_t sprtRejected;	// models rejected early by SPRT
+	uint64_t tested;		// points tested
+	uint64_t lmIterations;	// Levenberg-Marquardt iterations
+	uint64_t iterBound;		// final iteration bounds
+
+	estimatorStats() { memset(this, 0, sizeof(*this)); }
+	void add(const RHO_HEST_STATS& run, bool found);
+};
+
+/**
+* Stages of processFrame, in pipeline order
+*/
+enum frameStage {
+	STAGE_PYRAMID = 0,	// grayscale conversion and pyramid
+	STAGE_FAST,			// FAST9 keypoints
+	STAGE_BRIEF,		// hash indices and BRIEF descriptors
+	STAGE_MATCH,		// matching against the model
+	STAGE_SORT,			// grouping and PROSAC ordering of the matches
+	STAGE_RHO,			// homography estimation of the candidate targets
+	NUM_FRAME_STAGES
+};
+
+static inline const char* frameStageName(int stage) {
+	static const char* const names[NUM_FRAME_STAGES] = {
+		"pyramid", "fast", "brief", "match", "sort", "rho"
+	};
+	return stage >= 0 && stage < NUM_FRAME_STAGES ? names[stage] : "?";
+}
+
+/**
+* Wall time spent in every stage of the last processed frame (zero if
+* built with TANGO_PROFILE=0, see profiler.h)
+*/
+struct frameTiming {
+	uint64_t ns[NUM_FRAME_STAGES];
+
+	frameTiming() { reset(); }
+	void reset(void) { memset(ns, 0, sizeof(ns)); }
 };
 
 class frameProcessor {
@@ -79,58 +149,219 @@ public:
 	// Release and clean memory
 	int releaseProcessor(void);
 
-	// Load features table from a binary file
+	// Load features table from a binary file (replaces all targets)
 	int loadModelFromFile(const std::string&);
 
+	// Add the target of a binary model file to the current ones
+	int addModelFromFile(const std::string&);
+
+	// Replace the model. Safe to call from any thread while frames are
+	// processed: the next frame to start uses the new snapshot.
+	void setModel(const modelSnapshot& next);
+
+	// Load a binary model file on a background thread and return at once.
+	// The new model replaces all targets from the first frame processed
+	// after it is built; until a model is present no detection is done.
+	// A request made while a load is running is handed to the same
+	// thread and supersedes any request not started yet.
+	int loadModelFromFileAsync(const std::string&);
+
+	// Outcome of the last background load request
+	modelLoadStatus getModelLoadStatus(void) const {
+		return (modelLoadStatus)loadStatus.load();
+	}
+
+	// True while a background load is running or queued
+	bool isModelLoading(void) const { return getModelLoadStatus() == MODEL_LOADING; }
+
+	// Latest model given to the processor
+	modelSnapshot getModel(void) const;
+
+	// Targets located in the last processed frame
+	const std::vector<targetDetection>& getDetections(void) const { return detections; }
+
+	// Select how runtime features are matched against the model
+	void setMatchMode(matchMode mode) { matching = mode; }
+
+	// Number of neighbouring buckets (0 to MAX_PROBES) probed per query.
+	// Non-zero also walks the pyramid coarse-to-fine, stopping early.
+	void setProbeBudget(int budget) {
+		probeBudget = std::max(0, std::min(budget, MAX_PROBES));
+	}
+
+	// Per-stage time of the last processed frame
+	const frameTiming& getFrameTiming(void) const { return timing; }
+
+	// Descriptor comparison counters accumulated since the last reset
+	const matchStats& getMatchStats(void) const { return stats; }
+	void resetMatchStats(void) { stats = matchStats(); }
+
+	// Match "numFeatures" query features (and their MAX_PROBES probe
+	// buckets per feature, or NULL) against the current model, as the
+	// match stage of processFrame does for one full-scale level. For
+	// benchmarks; returns the number of matches.
+	uint32_t matchFeatures(const featureSet& features, const uint32_t* probes,
+						   uint32_t numFeatures);
+
+	// Homography estimation counters accumulated since the last reset
+	const estimatorStats& getEstimatorStats(void) const { return rhoStats; }
+	void resetEstimatorStats(void) { rhoStats = estimatorStats(); }
+
+	// Extract FAST9 features and BRIEF descriptor, with a hash index of
+	// "hashBits" bits (MIN_HASH_BITS to MAX_HASH_BITS)
+	void extractFeatures(const cv::Mat& gray, std::vector<Feature>& features,
+						 int hashBits = DEFAULT_HASH_BITS) const;
+
+	// Calculate the "hashBits"-bit index of the local patch.
+	// If "probes" is given, it receives up to probeBudget neighbouring
+	// indices obtained by flipping the least stable bits (NO_PROBE if unused).
+	uint32_t calcHashIndex(const cv::Mat& input, const cv::Point& pt,
+						   uint32_t* probes = NULL,
+						   int hashBits = DEFAULT_HASH_BITS) const;
+
 private:
-	// Extract FAST9 features and BRIEF descriptor
-	void extractFeatures(const cv::Mat& gray, std::vector<Feature>& features) const;
+
+	// Compute the BITS-bit index and BRIEF descriptor of the given
+	// keypoints. The arrays of "features" must hold keypoints.size()
+	// entries. Returns
+	// the number of features written (keypoints too close to the border
+	// are skipped). If "probes" is given, MAX_PROBES probe buckets per
+	// feature are written to it as well.
+	template<int BITS>
+	uint32_t describeFeatures(const cv::Mat& gray,
+							  const std::vector<cv::KeyPoint>& keypoints,
+							  const featureSet& features, uint32_t* probes) const;
+
+	// BITS-bit index of the patch centred on (xc, yc)
+	template<int BITS>
+	uint32_t hashIndex(const uint8_t* data, uint32_t step, int xc, int yc,
+					   uint32_t* probes) const;
+
+	// Match one pyramid level with the matcher selected for the model
+	void matchLevel(const featureSet& features, const uint32_t* probes,
+					uint32_t numFeatures, int pyramid);
 
 	// Match runtime features with the model features (local binary features)
-	void findBRIEFMatches(std::vector<Feature>& features, int pyramid);
+	// "probes" holds MAX_PROBES extra buckets per feature, or is NULL.
+	void findBRIEFMatches(const featureSet& features, const uint32_t* probes,
+						  uint32_t numFeatures, int pyramid);
+
+	// Same as findBRIEFMatches, but groups the query features by index
+	// first so that every model bucket is streamed from memory only once.
+	// BITS is the hash width of the model.
+	template<int BITS>
+	void findBRIEFMatchesByBucket(const featureSet& features, const uint32_t* probes,
+								  uint32_t numFeatures, int pyramid);
+
+	// Match through the MIH descriptor index of the model: every model
+	// feature within MIN_HAMMING_DIST is a candidate, whatever its bucket
+	void findBRIEFMatchesMIH(const featureSet& features, uint32_t numFeatures, int pyramid);
+
+	// Instances of the templates above for every hash width, indexed by
+	// hashBits - MIN_HASH_BITS, so that the width is resolved once per
+	// frame rather than per feature.
+	typedef uint32_t (frameProcessor::*describeFn)(const cv::Mat&,
+			const std::vector<cv::KeyPoint>&, const featureSet&, uint32_t*) const;
+	typedef void (frameProcessor::*matchFn)(const featureSet&, const uint32_t*,
+			uint32_t, int);
+	static const describeFn describers[MAX_HASH_BITS - MIN_HASH_BITS + 1];
+	static const matchFn bucketMatchers[MAX_HASH_BITS - MIN_HASH_BITS + 1];
+
+	int estimateH(const float* srcPoints, const float* dstPoints, unsigned npoints,
+				  float* H, uint32_t& numInliers);
+
+	int drawTargetBox(cv::Mat& src, const targetDetection& detection,
+					  const cv::Scalar& color) const;
 
-	// Calculate 13-bit index for using local patch
-	uint16_t calcHashIndex(const cv::Mat& input, const cv::Point& pt) const;
+	// Count a match of "target"
+	void vote(uint16_t target) {
+		maxVotes = std::max(maxVotes, ++targetVotes[target]);
+	}
+
+	// Pick up the last published model, if it changed
+	void installPendingModel(void);
+
+	// Publish "next" to the frame thread (publishLock held)
+	void publishModel(const modelSnapshot& next);
+
+	// Body of the loader thread: loads the requested files until no
+	// request is left
+	void loadRequestedModels(void);
+
+	// Per-frame scratch memory (runtime features, sorted matches, masks)
+	frameArena arena;
+
+	// Matching order
+	matchMode matching;
+
+	// Number of multi-probe buckets per query
+	int probeBudget;
+
+	// Descriptor comparison counters
+	matchStats stats;
+
+	// Homography estimation counters
+	estimatorStats rhoStats;
 
-	int estimateH(const std::vector<cv::Point2f>& srcPoints,
-				  const std::vector<cv::Point2f>& dstPoints);
+	// Stage times of the current frame
+	frameTiming timing;
 
-	int drawTargetBox(cv::Mat& src, const cv::Scalar& color) const;
+	// Grayscale pyramid of the query frame (full-, half- and quarter-scale)
+	cv::Mat scales[3];
 
-	// 3x3 matrix of homography
-	cv::Mat homography;
+	// FAST keypoints of the current pyramid level (MAX_FRAME_KEYPOINTS
+	// reserved, so FAST refills it in place)
+	std::vector<cv::KeyPoint> keypoints;
+
+	// Homography estimation context, kept alive across frames
+	RHO_HEST_REFC* rho;
+
+	// Matches of the current frame, in the order they were found
 	vector<D_MATCH> matches;
-	// 2D feature points from query frame
-	std::vector<cv::Point2f> srcPoints;
 
-	// 2D feature points from trained model
-	std::vector<cv::Point2f> dstPoints;
+	// Number of matches per target in the current frame, and the
+	// largest of them
+	std::vector<uint32_t> targetVotes;
+	uint32_t maxVotes;
+
+	// Targets located in the current frame
+	std::vector<targetDetection> detections;
+
+	// Visit stamps of the model features for MIH matching, and the last
+	// stamp handed out
+	std::vector<uint32_t> mihStamps;
+	uint32_t mihStamp;
 
 	// Pairwise test location used in BRIEF descriptor
 	static const int8_t BRIEFLoc[256][4];
 
-	// Look-up table to store model features and indices
-	std::vector<Feature> featureTable;
-	std::vector<uint32_t> indexTbl[8192];	// 2^(13bits)
+	// Sample locations of the index (most significant bit first). An
+	// n-bit index uses the first n; the first 13 are the original pattern.
+	static const int8_t hashLoc[MAX_HASH_BITS][2];
 
-	// A Vector stroring four corners of the target image
-	vector<Point2f> trgCorners;
-};
+	// Model snapshot of the frame being processed. Only the frame
+	// thread reads or replaces it.
+	modelSnapshot model;
 
-static inline int int32BitCount(unsigned v) {
-    // http://www-graphics.stanford.edu/~seander/bithacks.html#CountBitsSetParallel
-    v = v - ((v >> 1) & 0x55555555);
-    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
-    return (((v + (v >> 4)) & 0xF0F0F0F) * 0x1010101) >> 24;	// count
-}
+	// Writer side: the last published snapshot and the one before it.
+	// The previous snapshot is kept alive here so that the frame thread
+	// never frees a whole model when it moves to the new one.
+	// Frames never take publishLock.
+	modelSnapshot published;
+	modelSnapshot retired;
+	mutable std::mutex publishLock;
 
-static inline int descriptorBitCount(unsigned* desc) {
-    int dword_count = DESCRIPTOR_SIZE;
-    int i, bitCount = 0;
-    for (i = 0; i < dword_count; i++){
-    	bitCount += int32BitCount(desc[i]);
-    }
-    return bitCount;
-}
+	// Published snapshot not yet picked up by the frame thread
+	std::atomic<modelSnapshot*> pendingModel;
+
+	// Background loader. loadLock guards the request and the running
+	// flag; the thread exits once it finds no request left.
+	std::thread loader;
+	std::mutex loadLock;
+	std::string loadRequest;
+	bool loadRequested;
+	bool loaderRunning;
+	std::atomic<int> loadStatus;
+};
 
 #endif  // FRAME_PROCESSOR_H_
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#ifndef FRAME_RECORDING_H_
+#define FRAME_RECORDING_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#define RECORDING_MAGIC			0x3132564E	// "NV21", first word of a recording
+#define RECORDING_VERSION		2
+#define CHUNK_INTRINSICS		0x52544E49	// "INTR", recordingIntrinsics
+#define CHUNK_FRAME				0x4D415246	// "FRAM", recordingFrame + NV21 image
+#define CHUNK_POSE				0x45534F50	// "POSE", recordingPose
+#define RECORDER_NUM_BUFFERS	8			// Frames queued before the recorder drops
+#define RECORDER_NUM_POSES		64			// Poses queued before the recorder drops
+
+/**
+* Recorded camera frames and device poses
+*
+* A recording file is a recordingHeader followed by chunks. Every chunk
+* is a recordingChunk header and "size" bytes of payload, padded to a
+* multiple of 8 bytes; every payload therefore starts 8-byte aligned,
+* and a reader can map the file and use the frames in place. Unknown
+* chunks are skipped and a truncated last chunk (recorder killed) is
+* ignored.
+*
+* A frame chunk holds a recordingFrame and width*height*3/2 bytes of
+* NV21 image (full-resolution Y plane, then interleaved V/U at half
+* resolution), exactly as delivered by the color camera. Poses are
+* those of the device in the start-of-service frame, at or near frame
+* timestamps.
+*
+* A directory of raw "*.nv21" files of the same size, replayed in name
+* order, is accepted by the reader as well.
+*/
+struct recordingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;			// Frame size
+	uint32_t height;
+};
+
+struct recordingChunk {
+	uint32_t tag;
+	uint32_t size;			// Payload bytes, without padding
+};
+
+struct recordingIntrinsics {
+	double	 fx, fy;		// Focal lengths in pixels
+	double	 cx, cy;		// Principal point in pixels
+	double	 distortion[5];	// Distortion coefficients as given by the camera
+	uint32_t width, height;	// Calibrated image size
+	uint32_t model;			// Calibration type as given by the camera
+	uint32_t reserved;
+};
+
+struct recordingFrame {
+	double	 timestamp;		// Camera timestamp in seconds
+};
+
+struct recordingPose {
+	double	 timestamp;		// Pose timestamp in seconds
+	double	 translation[3];
+	double	 orientation[4];	// Quaternion (x, y, z, w)
+	int32_t	 status;		// Pose status as given by the service
+	int32_t	 reserved;
+};
+
+/**
+* Read-only view of a recording. Files are memory-mapped, so frames are
+* not copied; a directory of raw frames is read into memory.
+*/
+class frameRecording {
+public:
+
+	// Constructor and deconstructor.
+	frameRecording();
+	~frameRecording();
+
+	// Open a recording file, or a directory of raw NV21 frames of
+	// "width" x "height" (ignored for recording files)
+	int open(const std::string& path, uint32_t width = 0, uint32_t height = 0);
+
+	// Release the recording
+	void close(void);
+
+	uint32_t width(void) const { return frameWidth; }
+	uint32_t height(void) const { return frameHeight; }
+	uint32_t numFrames(void) const { return frames.size(); }
+
+	// NV21 image and timestamp of frame i
+	const uint8_t* frame(uint32_t i) const { return frames[i]; }
+	double timestamp(uint32_t i) const { return timestamps[i]; }
+
+	// Bytes of one NV21 frame
+	size_t frameSize(void) const { return (size_t)frameWidth * frameHeight * 3 / 2; }
+
+	// Camera intrinsics, or NULL if the recording has none
+	const recordingIntrinsics* intrinsics(void) const { return cameraIntrinsics; }
+
+	// Device poses, in recording order
+	const std::vector<recordingPose>& poses(void) const { return devicePoses; }
+
+private:
+	// Forbid copying
+	frameRecording(const frameRecording&);
+	frameRecording& operator =(const frameRecording&);
+
+	int openFile(const std::string& filename);
+	int openDirectory(const std::string& dirname);
+
+	uint32_t frameWidth;
+	uint32_t frameHeight;
+	std::vector<const uint8_t*> frames;
+	std::vector<double> timestamps;
+	const recordingIntrinsics* cameraIntrinsics;
+	std::vector<recordingPose> devicePoses;
+
+	// File mapping, or frames read from a directory
+	void* mapping;
+	size_t mappingSize;
+	std::vector<uint8_t> storage;
+};
+
+/**
+* Writes a recording from a background thread.
+*
+* All frame buffers are allocated by start(); addFrame() only copies
+* the image into a free buffer and queues it, so that the camera thread
+* never waits on the disk. Frames arriving while every buffer is queued
+* are dropped from the recording (and counted), never from the app.
+*/
+class frameRecorder {
+public:
+
+	// Constructor and deconstructor.
+	frameRecorder();
+	~frameRecorder();
+
+	// Create "filename" and start the writer. "intrinsics" may be NULL.
+	int start(const std::string& filename, uint32_t width, uint32_t height,
+			  const recordingIntrinsics* intrinsics,
+			  uint32_t numBuffers = RECORDER_NUM_BUFFERS);
+
+	// Write what is queued and close the file
+	void stop(void);
+
+	bool isRecording(void) const { return recording; }
+
+	// Queue a frame (width*height*3/2 bytes of NV21) or a pose.
+	// Returns RET_FAILED if it was dropped.
+	int addFrame(const uint8_t* nv21, double timestamp);
+	int addPose(const recordingPose& pose);
+
+	// Frames written and dropped since start()
+	uint32_t numWritten(void) const { return written; }
+	uint32_t numDropped(void) const { return dropped; }
+
+private:
+	// Forbid copying
+	frameRecorder(const frameRecorder&);
+	frameRecorder& operator =(const frameRecorder&);
+
+	// Writer thread
+	void run(void);
+
+	int writeChunk(uint32_t tag, const void* head, uint32_t headSize,
+				   const void* data, uint32_t dataSize);
+
+	FILE* dFile;
+	size_t frameSize;
+
+	// Preallocated frame buffers and their timestamps
+	std::vector<uint8_t> buffers;
+	std::vector<double> bufferTimestamps;
+
+	// Free buffers, queued buffers (in order) and queued poses
+	std::vector<uint32_t> freeBuffers;
+	std::vector<uint32_t> frameQueue;
+	uint32_t frameHead, frameCount;
+	std::vector<recordingPose> poseQueue;
+	uint32_t poseHead, poseCount;
+
+	std::mutex queueLock;
+	std::condition_variable queueReady;
+	bool stopping;
+
+	std::thread writer;
+	std::atomic<bool> recording;
+	std::atomic<uint32_t> written;
+	std::atomic<uint32_t> dropped;
+};
+
+#endif  // FRAME_RECORDING_H_
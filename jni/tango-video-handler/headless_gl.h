@@ -0,0 +1,53 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#ifndef HEADLESS_GL_H_
+#define HEADLESS_GL_H_
+
+#include <stdint.h>
+#include <string>
+#include <EGL/egl.h>
+
+/**
+* Offscreen OpenGL ES 2 context for host builds
+*
+* An EGL pbuffer surface with a GLES 2 context, current on the calling
+* thread, so that the GL code of the app (VideoOverlayApp, YUVDrawable)
+* runs on a Linux machine without a display. Mesa's surfaceless
+* platform is used when it is available, with its software rasteriser
+* (llvmpipe) unless a GPU driver is found; LIBGL_ALWAYS_SOFTWARE=1
+* forces the rasteriser.
+*/
+class headlessGL {
+public:
+
+	// Constructor and deconstructor.
+	headlessGL();
+	~headlessGL();
+
+	// Create the context and a "width" x "height" pbuffer, and make them
+	// current on the calling thread
+	int create(uint32_t width, uint32_t height);
+
+	// Release the context and the surface
+	void destroy(void);
+
+	// End of a frame (a pbuffer has no back buffer to show)
+	void swapBuffers(void);
+
+	// GL_RENDERER and GL_VERSION strings of the context
+	std::string renderer(void) const;
+
+private:
+	// Forbid copying
+	headlessGL(const headlessGL&);
+	headlessGL& operator =(const headlessGL&);
+
+	EGLDisplay display;
+	EGLSurface surface;
+	EGLContext context;
+};
+
+#endif  // HEADLESS_GL_H_
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#ifndef MIH_INDEX_H_
+#define MIH_INDEX_H_
+
+#include <vector>
+#include "feature.h"
+
+/**
+* Multi-index hashing over the BRIEF descriptors
+*
+* The 256-bit descriptor is split into m substrings of 256/m bits, each
+* with its own direct-addressed table. If two descriptors are within
+* Hamming radius r, at least one pair of substrings is within r/m bits
+* (pigeonhole), so probing every table with all the keys at most r/m
+* bits away from the query substring finds every model feature within r.
+* Candidates are verified on the full descriptor.
+*
+* m = 16 (16-bit keys, 16 x 64K-bucket tables) probes 137 keys per table
+* for r = 46; m = 32 (8-bit keys, 32 x 256-bucket tables) probes 9 keys
+* per table but gets longer buckets.
+*/
+class mihIndex {
+public:
+
+	// Constructor and deconstructor.
+	mihIndex();
+	~mihIndex();
+
+	// Index "numFeatures" descriptors with m = "numSubstrings" (16 or 32)
+	int build(const Descriptor* descriptors, uint32_t numFeatures, int numSubstrings);
+
+	// Drop the index
+	void clear(void);
+
+	// Exchange the contents with another index (no copy)
+	void swap(mihIndex& other);
+
+	bool empty(void) const { return m == 0; }
+	int numSubstrings(void) const { return m; }
+
+	/**
+	* Nearest of "descriptors" (the array the index was built on) within
+	* "radius" bits of "descriptor". Returns its distance, or radius + 1
+	* if there is none. "stamps" holds one entry per model feature, all
+	* different from "stamp"; entries of the visited features are set to
+	* "stamp" so that each is verified once.
+	*/
+	int nearest(const uint32_t* descriptor, int radius, const Descriptor* descriptors,
+				uint32_t* stamps, uint32_t stamp, uint32_t& nearestIdx,
+				uint64_t& candidates, uint64_t& words) const;
+
+private:
+
+	// Key of substring "s" of a descriptor
+	inline uint32_t key(const uint32_t* descriptor, int s) const;
+
+	int m;			// Number of substrings (0 if empty)
+	int keyBits;	// Bits per substring (256 / m)
+
+	// Table s: ids[s*n + offsets[s*(2^keyBits+1) + key] ...
+	//               s*n + offsets[s*(2^keyBits+1) + key + 1])
+	uint32_t n;
+	std::vector<uint32_t> offsets;
+	std::vector<uint32_t> ids;
+};
+
+#endif  // MIH_INDEX_H_
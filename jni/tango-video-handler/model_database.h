@@ -0,0 +1,121 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#ifndef MODEL_DATABASE_H_
+#define MODEL_DATABASE_H_
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include "feature.h"
+#include "mih_index.h"
+
+#define MAX_NUM_TARGETS		65535	// Target ids are stored on 16 bits
+
+/**
+* Bound on the length of a bucket holding features of several targets.
+* Matching cost is the length of the scanned buckets, so the bound keeps
+* it from growing with the number of targets. A bucket of one target
+* alone is left as the model built it.
+*/
+#define MAX_BUCKET_LENGTH	32
+
+/**
+* A planar target of the database
+*/
+struct modelTarget {
+	cv::Size	size;			// Size of the target image
+	cv::Point2f	corners[4];		// Four corners of the target image
+	uint32_t	firstFeature;	// Range of the target in the feature table
+	uint32_t	numFeatures;
+};
+
+/**
+* Model features of one or more planar targets, sharing a single
+* bucketed index. Every feature is tagged with the id of its target,
+* so one index lookup finds candidates of all targets at once.
+*/
+class modelDatabase {
+public:
+
+	// Constructor and deconstructor.
+	explicit modelDatabase(int hashBits = DEFAULT_HASH_BITS);
+	~modelDatabase();
+
+	// Remove all targets
+	void clear(void);
+
+	// Exchange the contents with another database (no copy)
+	void swap(modelDatabase& other);
+
+	// Append a target given its features and per-bucket feature lists
+	// (2^hashBits lists of indices into "features"). The first target
+	// sets the hash width of the database; later ones must match it.
+	// Buckets shared by several targets are bounded to MAX_BUCKET_LENGTH
+	// entries, the targets with the most entries giving theirs up first.
+	// The descriptor index, if enabled, is dropped until buildIndex().
+	// Returns the id of the new target, or RET_FAILED.
+	int addTarget(const cv::Size& size, const std::vector<Feature>& features,
+				  const std::vector<std::vector<uint32_t> >& indexTbl);
+
+	// Append a target read from a binary model file (model.bin, raw or
+	// compressed). A file asking for a descriptor index enables it, to be
+	// built by buildIndex().
+	// Returns the id of the new target, or RET_FAILED.
+	int addTargetFromFile(const std::string& filename);
+
+	uint32_t numTargets(void) const { return targets.size(); }
+	uint32_t numFeatures(void) const { return descriptorTbl.size(); }
+	bool empty(void) const { return targets.empty(); }
+
+	// Index the descriptors of all the targets with multi-index hashing
+	// over "numSubstrings" (16 or 32) substrings, 0 to drop it. The index
+	// is built at once.
+	int setMIHSubstrings(int numSubstrings);
+
+	// Rebuild the descriptor index, if enabled, after the last of a
+	// series of addTarget() calls. Until then matching falls back to the
+	// hash index.
+	int buildIndex(void);
+	const mihIndex& mih(void) const { return mihTbl; }
+
+	// Width of the hash index and number of buckets (2^hashBits)
+	int hashBits(void) const { return ::hashBitsOf(indexTbl.size()); }
+	uint32_t numBuckets(void) const { return indexTbl.size(); }
+
+	const modelTarget& target(uint32_t id) const { return targets[id]; }
+	const Descriptor& descriptor(uint32_t idx) const { return descriptorTbl[idx]; }
+	const featureLocation& location(uint32_t idx) const { return locationTbl[idx]; }
+	const Descriptor* descriptors(void) const { return descriptorTbl.data(); }
+	uint16_t featureTarget(uint32_t idx) const { return targetTbl[idx]; }
+	const std::vector<uint32_t>& bucket(uint32_t index) const { return indexTbl[index]; }
+
+private:
+	// Look-up tables to store model features and indices. Descriptors
+	// and locations are kept apart so that matching only streams the
+	// descriptors; locations are read for the accepted matches.
+	descriptorArray descriptorTbl;
+	std::vector<featureLocation> locationTbl;
+	std::vector<std::vector<uint32_t> > indexTbl;
+
+	// Target id of every model feature
+	std::vector<uint16_t> targetTbl;
+
+	// Targets of the database
+	std::vector<modelTarget> targets;
+
+	// Optional descriptor index and its number of substrings (0 if none)
+	mihIndex mihTbl;
+	int mihSubstrings;
+};
+
+/**
+* Immutable, reference-counted model. A frame holds the snapshot it
+* started with, so replacing the model never disturbs a frame in flight.
+*/
+typedef std::shared_ptr<const modelDatabase> modelSnapshot;
+
+#endif  // MODEL_DATABASE_H_
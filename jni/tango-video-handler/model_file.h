@@ -0,0 +1,74 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#ifndef MODEL_FILE_H_
+#define MODEL_FILE_H_
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+#include "feature.h"
+
+#define MODEL_MAGIC		0x315A4D54	// "TMZ1", first word of a compressed model
+#define MODEL_EXT_MIH	0x3148494D	// "MIH1", number of MIH substrings
+
+/**
+* On-disk encodings of a single-target model
+*
+* MODEL_RAW is the original model.bin layout: the image size, the
+* Feature records (40 bytes each: descriptor, 16-bit x and y, 32-bit
+* hash index) and, for every bucket, a 64-bit byte length followed by
+* 32-bit feature indices.
+*
+* MODEL_COMPRESSED starts with MODEL_MAGIC and stores the descriptors
+* as-is (they do not compress), the locations as packed 16-bit pairs,
+* and the feature hash indices, bucket lengths and delta-coded bucket
+* lists as Stream VByte integer streams. Unlike MODEL_RAW, which is
+* always 13-bit, it stores any hash width from MIN_HASH_BITS to
+* MAX_HASH_BITS, and may ask for a multi-index hashing descriptor index
+* to be built at load time (see mihIndex).
+*/
+enum modelFormat {
+	MODEL_RAW		 = 0,
+	MODEL_COMPRESSED = 1
+};
+
+// Read a model file of either format.
+// "indexTbl" receives 2^hashBits lists of indices into "features", the
+// hash width being the one of the file. "mihSubstrings", if given,
+// receives the number of MIH substrings requested by the file (0 if none).
+int readModelFile(const std::string& filename, cv::Size& size,
+				  std::vector<Feature>& features,
+				  std::vector<std::vector<uint32_t> >& indexTbl,
+				  int* mihSubstrings = NULL);
+
+// Write a model file; "indexTbl" holds 2^hashBits lists
+// (INDEX_TABLE_SIZE for MODEL_RAW). A non-zero "mihSubstrings" (compressed
+// format only) selects the MIH descriptor index for this model.
+int writeModelFile(const std::string& filename, const cv::Size& size,
+				   const std::vector<Feature>& features,
+				   const std::vector<std::vector<uint32_t> >& indexTbl,
+				   modelFormat format, int mihSubstrings = 0);
+
+/**
+* Stream VByte: 2-bit length codes of four integers share a control
+* byte, and the 1 to 4 data bytes of each integer follow in a separate
+* stream. Decoding needs no per-byte branch and maps to one shuffle
+* per four integers (SSSE3 / NEON).
+*/
+
+// Upper bound of the encoded size of n integers
+static inline size_t streamVByteMaxSize(uint32_t n) { return (n + 3) / 4 + 4 * (size_t)n; }
+
+// Encode n integers; "out" must hold streamVByteMaxSize(n) bytes.
+// Returns the encoded size.
+size_t streamVByteEncode(const uint32_t* in, uint32_t n, uint8_t* out);
+
+// Decode n integers from [in, end). Returns the end of the encoded
+// stream, or NULL if it is truncated.
+const uint8_t* streamVByteDecode(const uint8_t* in, const uint8_t* end,
+								 uint32_t n, uint32_t* out);
+
+#endif  // MODEL_FILE_H_
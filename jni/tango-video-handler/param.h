@@ -8,11 +8,18 @@
 #ifndef PARAM_H_
 #define PARAM_H_
 
-#include <android/log.h>
-
 #define TAG_LOG "tano-AR:native"
+
+#ifdef __ANDROID__
+#include <android/log.h>
 #define LOG_I(...) __android_log_print(ANDROID_LOG_INFO,TAG_LOG,__VA_ARGS__)
 #define LOG_E(...) __android_log_print(ANDROID_LOG_ERROR,TAG_LOG,__VA_ARGS__)
+#else
+// Host (offline tools) build: log to stderr
+#include <stdio.h>
+#define LOG_I(...) (fprintf(stderr, TAG_LOG " I: " __VA_ARGS__))
+#define LOG_E(...) (fprintf(stderr, TAG_LOG " E: " __VA_ARGS__))
+#endif
 
 // Minimum number of matches required to estimate homography
 #define MIN_NUM_MATCHES				100
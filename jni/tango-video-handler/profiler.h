@@ -0,0 +1,176 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <atomic>
+#include <chrono>
+
+/**
+* Hot-path instrumentation
+*
+* PROFILE_SCOPE(zone) times the enclosing scope with the monotonic clock
+* (PROFILE_TIMER(name, ...) / PROFILE_STOP(name) an explicit section)
+* and appends (zone, start, duration) to a ring buffer owned by the
+* calling thread: no lock and no allocation on the hot path. Rings are
+* drained into per-zone latency histograms only when a report is asked
+* for (profiler::collect()). Events overwritten before a collect are
+* lost, not blocked on.
+*
+* Between startTrace() and stopTrace() a background thread also drains
+* the rings every PROFILE_TRACE_PERIOD_MS and keeps the events, which
+* stopTrace() writes as Chrome trace JSON (chrome://tracing, Perfetto).
+* Every event carries the id of the camera frame being handled by its
+* thread when it ends (setFrameId()), so that one frame can be followed
+* from the camera thread to the GL thread across the timeline.
+*
+* Building with TANGO_PROFILE=0 removes the timers altogether; the
+* per-frame stage times of frameProcessor then stay at zero.
+*/
+#ifndef TANGO_PROFILE
+#define TANGO_PROFILE				1
+#endif
+
+#define PROFILE_RING_SIZE			4096	// Events per thread (power of two)
+#define PROFILE_HIST_SUB_BITS		3		// 8 sub-buckets per power of two (12.5%)
+#define PROFILE_HIST_BUCKETS		(16 + (64 - 4) * 8)
+#define PROFILE_TRACE_PERIOD_MS		50		// Ring drain period while tracing
+#define PROFILE_MAX_TRACE_EVENTS	(1 << 20)	// Events kept by one trace
+
+/**
+* Instrumented zones
+*/
+enum profileZone {
+	ZONE_PYRAMID = 0,		// processFrame stages, in pipeline order
+	ZONE_FAST,
+	ZONE_BRIEF,
+	ZONE_MATCH,
+	ZONE_SORT,
+	ZONE_RHO,
+	ZONE_PROCESS_FRAME,		// whole processFrame
+	ZONE_ESTIMATE_H,		// one homography estimation
+	ZONE_YUV_TO_RGB,		// NV21 to RGB conversion of a camera frame
+	ZONE_RENDER_YUV,		// RenderYUV, including the above and processFrame
+	ZONE_FRAME_AVAILABLE,	// camera callback (OnFrameAvailable)
+	ZONE_RHO_REFC,			// one rhoRefC call
+	ZONE_TEXTURE_UPLOAD,	// RGB frame to the YUV drawable texture
+	ZONE_DRAW,				// YUV drawable render
+	NUM_PROFILE_ZONES
+};
+
+// Monotonic time in nanoseconds
+static inline uint64_t profileNowNs(void) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+* Log-linear latency histogram: exact below 16 ns, then 8 buckets per
+* power of two
+*/
+struct latencyHistogram {
+	uint64_t counts[PROFILE_HIST_BUCKETS];
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+
+	latencyHistogram() { reset(); }
+	void reset(void);
+	void add(uint64_t ns);
+
+	// Upper bound of the bucket holding percentile p (0 to 100)
+	uint64_t percentile(double p) const;
+	double mean(void) const { return count ? (double)sum / count : 0.0; }
+
+	static int bucketOf(uint64_t ns);
+	static uint64_t bucketUpperBound(int bucket);
+};
+
+class profiler {
+public:
+
+	// Append an event to the ring of the calling thread
+	static void record(int zone, uint64_t start, uint64_t ns);
+
+	// Frame id attached to the next events of the calling thread
+	static void setFrameId(uint32_t frameId);
+
+	// Name of the calling thread in traces
+	static void setThreadName(const char* name);
+
+	// Drain the rings of all threads into the histograms
+	static void collect(void);
+
+	// Clear the histograms (and the events not collected yet)
+	static void reset(void);
+
+	// Copy of the histogram of a zone, after a collect()
+	static latencyHistogram histogram(int zone);
+
+	// Collect, then print count, mean, p50, p95, p99 and max of every
+	// zone with events, in milliseconds
+	static std::string report(void);
+
+	// Keep every event from now on
+	static void startTrace(void);
+
+	// Stop tracing and write the kept events as Chrome trace JSON
+	static int stopTrace(const std::string& filename);
+
+	static bool tracing(void);
+
+	static const char* zoneName(int zone);
+};
+
+#if TANGO_PROFILE
+
+/**
+* Times its scope, or until stop(). If "accumulator" is given the
+* duration is also added to it (per-frame stage times).
+*/
+class scopedTimer {
+public:
+	explicit scopedTimer(int zone, uint64_t* accumulator = NULL) :
+		zone(zone), accumulator(accumulator), start(profileNowNs()) {}
+	~scopedTimer() { stop(); }
+
+	void stop(void) {
+		if(zone < 0){
+			return;
+		}
+		uint64_t ns = profileNowNs() - start;
+		if(accumulator){
+			*accumulator += ns;
+		}
+		profiler::record(zone, start, ns);
+		zone = -1;
+	}
+
+private:
+	int			zone;
+	uint64_t*	accumulator;
+	uint64_t	start;
+};
+
+#define PROFILE_CONCAT_(a, b)			a##b
+#define PROFILE_CONCAT(a, b)			PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(zone)				scopedTimer PROFILE_CONCAT(profileTimer_, __LINE__)(zone)
+#define PROFILE_TIMER(name, zone, acc)	scopedTimer name(zone, acc)
+#define PROFILE_STOP(name)				name.stop()
+
+#else
+
+#define PROFILE_SCOPE(zone)				do {} while(0)
+#define PROFILE_TIMER(name, zone, acc)	do {} while(0)
+#define PROFILE_STOP(name)				do {} while(0)
+
+#endif  // TANGO_PROFILE
+
+#endif  // PROFILER_H_
@@ -21,6 +21,7 @@
 #include <jni.h>
 #include <memory>
 #include <mutex>
+#include <string>
 
 #include <tango_client_api.h>  // NOLINT
 #include <tango-gl/util.h>
@@ -32,6 +33,7 @@
 #include "param.h"
 #include "yuv_drawable.h"
 #include "frame_processor.h"
+#include "frame_recording.h"
 
 namespace tango_video_overlay {
 
@@ -95,6 +97,37 @@ class VideoOverlayApp {
     }
   // Load visual features from the binary file
   int LoadTargetModel(JNIEnv* env, jstring path);
+  int LoadTargetModel(const std::string& path);
+
+  // Load visual features from the binary file on a background thread.
+  // Returns at once; the model is used from the first frame after it is built.
+  int LoadTargetModelAsync(JNIEnv* env, jstring path);
+
+  // True while a background model load is running
+  bool IsTargetModelLoading();
+
+  // Outcome of the last background model load (modelLoadStatus)
+  int GetTargetModelStatus();
+
+  // Record the color camera frames, with the camera intrinsics and the
+  // device poses, to the given file until StopRecording() is called.
+  int StartRecording(JNIEnv* env, jstring path);
+  void StopRecording();
+  bool IsRecording() { return recorder_.isRecording(); }
+
+  // Latency histograms of the instrumented zones (profiler.h), as a
+  // text table, and their reset
+  std::string GetProfileReport();
+  void ResetProfile();
+
+  // Timeline of the instrumented zones, written as Chrome trace JSON
+  // to the given file by StopTrace()
+  void StartTrace();
+  int StopTrace(JNIEnv* env, jstring path);
+
+  // Wait for the GL to finish the texture upload and the draw of every
+  // frame, so that their timers include the GPU work (benchmarks)
+  void SetFinishGL(bool finish) { finish_gl_ = finish; }
 
  private:
   // The projection matrix for the first person AR camera.
@@ -113,6 +146,7 @@ class VideoOverlayApp {
   TangoCameraIntrinsics color_camera_intrinsics_;
 
   TextureMethod current_texture_method_;
+  bool finish_gl_;
 
   std::vector<uint8_t> yuv_buffer_;
   std::vector<uint8_t> yuv_temp_buffer_;
@@ -122,11 +156,24 @@ class VideoOverlayApp {
   std::atomic<bool> swap_buffer_signal_;
   std::mutex yuv_buffer_mutex_;
 
+  // Id of the last camera frame, and of the frames in the YUV buffers,
+  // tagging the trace events of the camera and GL threads
+  uint32_t frame_id_;
+  uint32_t yuv_temp_frame_id_;
+  uint32_t yuv_frame_id_;
+
   size_t yuv_width_;
   size_t yuv_height_;
   size_t yuv_size_;
   size_t uv_buffer_offset_;
 
+  // Frame recorder (written by a background thread) and the frame size
+  // it was started with
+  frameRecorder recorder_;
+  uint32_t recording_width_;
+  uint32_t recording_height_;
+
+  void RecordFrame(const TangoImageBuffer* buffer);
   void AllocateTexture(GLuint texture_id, int width, int height);
   void RenderYUV();
   void RenderTextureId();
@@ -15,7 +15,7 @@
  */
 
 #include "tango-video-handler/tango_handler.h"
-#include <sys/time.h>
+#include "tango-video-handler/profiler.h"
 #include <string>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -23,12 +23,6 @@
 // processor_ processes the input frame
 static frameProcessor processor_;
 
-long long currentTimeInMilliseconds() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return ((tv.tv_sec * 1000) + (tv.tv_usec / 1000));
-}
-
 namespace {
 
 void OnFrameAvailableRouter(void* context, TangoCameraId,
@@ -52,8 +46,15 @@ inline void Yuv2Rgb(uint8_t yValue, uint8_t uValue, uint8_t vValue, uint8_t* r,
 namespace tango_video_overlay {
 
 VideoOverlayApp::VideoOverlayApp() {
+	tango_config_ = nullptr;
+	finish_gl_ = false;
 	is_yuv_texture_available_ = false;
 	swap_buffer_signal_ = false;
+	recording_width_ = 0;
+	recording_height_ = 0;
+	frame_id_ = 0;
+	yuv_temp_frame_id_ = 0;
+	yuv_frame_id_ = 0;
 }
 
 VideoOverlayApp::~VideoOverlayApp() {
@@ -63,6 +64,16 @@ VideoOverlayApp::~VideoOverlayApp() {
 }
 
 void VideoOverlayApp::OnFrameAvailable(const TangoImageBuffer* buffer) {
+	if (frame_id_ == 0) {
+		profiler::setThreadName("camera");
+	}
+	profiler::setFrameId(++frame_id_);
+	PROFILE_SCOPE(ZONE_FRAME_AVAILABLE);
+
+	// Recording does not depend on the display method
+	if (recorder_.isRecording()) {
+		RecordFrame(buffer);
+	}
 
 	if (current_texture_method_ != TextureMethod::kYUV) {
 		return;
@@ -98,9 +109,39 @@ void VideoOverlayApp::OnFrameAvailable(const TangoImageBuffer* buffer) {
 
 	std::lock_guard<std::mutex> lock(yuv_buffer_mutex_);
 	memcpy(&yuv_temp_buffer_[0], buffer->data, yuv_size_);
+	yuv_temp_frame_id_ = frame_id_;
 	swap_buffer_signal_ = true;
 }
 
+void VideoOverlayApp::RecordFrame(const TangoImageBuffer* buffer) {
+	if (buffer->format != TANGO_HAL_PIXEL_FORMAT_YCrCb_420_SP ||
+		buffer->width != recording_width_ || buffer->height != recording_height_) {
+		return;
+	}
+	// Only copied here; the disk is written by the recorder thread
+	recorder_.addFrame(buffer->data, buffer->timestamp);
+
+	// Device pose at the frame time, when the service has one
+	TangoCoordinateFramePair pair;
+	pair.base = TANGO_COORDINATE_FRAME_START_OF_SERVICE;
+	pair.target = TANGO_COORDINATE_FRAME_DEVICE;
+	TangoPoseData pose;
+	if (TangoService_getPoseAtTime(buffer->timestamp, pair, &pose) == TANGO_SUCCESS &&
+		pose.status_code == TANGO_POSE_VALID) {
+		recordingPose record;
+		record.timestamp = pose.timestamp;
+		for (int i = 0; i < 3; i++) {
+			record.translation[i] = pose.translation[i];
+		}
+		for (int i = 0; i < 4; i++) {
+			record.orientation[i] = pose.orientation[i];
+		}
+		record.status = pose.status_code;
+		record.reserved = 0;
+		recorder_.addPose(record);
+	}
+}
+
 int VideoOverlayApp::TangoInitialize(JNIEnv* env, jobject caller_activity) {
 	// The first thing we need to do for any Tango enabled application is to
 	// initialize the service. We'll do that here, passing on the JNI environment
@@ -163,6 +204,7 @@ void VideoOverlayApp::TangoDisconnect() {
 }
 
 void VideoOverlayApp::InitializeGLContent() {
+	profiler::setThreadName("GL");
 	video_overlay_drawable_ = new tango_gl::VideoOverlay();
 	_marker = new tango_gl::GoalMarker();
 	yuv_drawable_ = new YUVDrawable();
@@ -230,7 +272,6 @@ void VideoOverlayApp::SetViewPort(int width, int height) {
 }
 
 void VideoOverlayApp::Render() {
-	int64_t t1 = currentTimeInMilliseconds();
 	glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
 	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 	switch (current_texture_method_) {
@@ -241,9 +282,6 @@ void VideoOverlayApp::Render() {
 		RenderTextureId();
 		break;
 	}
-	t1 = currentTimeInMilliseconds() - t1;
-	LOGE("time taken is %f \n", (float)t1/1000.f);
-
 }
 
 void VideoOverlayApp::FreeGLContent() {
@@ -271,18 +309,25 @@ void VideoOverlayApp::RenderYUV() {
 	if (!is_yuv_texture_available_) {
 		return;
 	}
+	PROFILE_SCOPE(ZONE_RENDER_YUV);
 	{
 		std::lock_guard<std::mutex> lock(yuv_buffer_mutex_);
 		if (swap_buffer_signal_) {
 			std::swap(yuv_buffer_, yuv_temp_buffer_);
+			yuv_frame_id_ = yuv_temp_frame_id_;
 			swap_buffer_signal_ = false;
 		}
 	}
+	// Events are tagged when they end: this scope belongs to the frame
+	// drawn, as does processFrame
+	profiler::setFrameId(yuv_frame_id_);
 
 	cv::Mat src = cv::Mat(yuv_height_*3/2,yuv_width_,CV_8U, &yuv_buffer_[0]);
 	cv::Mat dst = cv::Mat(yuv_height_,yuv_width_,CV_8UC3);
 
+	PROFILE_TIMER(convertTimer, ZONE_YUV_TO_RGB, NULL);
 	cv::cvtColor(src,dst, CV_YUV2RGB_NV21);
+	PROFILE_STOP(convertTimer);
 	processor_.processFrame(dst, dst);
 
 #if 0
@@ -308,11 +353,21 @@ void VideoOverlayApp::RenderYUV() {
 	}
 #endif
 
+	PROFILE_TIMER(uploadTimer, ZONE_TEXTURE_UPLOAD, NULL);
 	glBindTexture(GL_TEXTURE_2D, yuv_drawable_->GetTextureId());
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, yuv_width_, yuv_height_, 0, GL_RGB,
 			GL_UNSIGNED_BYTE, dst.data);
+	if (finish_gl_) {
+		glFinish();
+	}
+	PROFILE_STOP(uploadTimer);
 
+	PROFILE_TIMER(drawTimer, ZONE_DRAW, NULL);
 	yuv_drawable_->Render(glm::mat4(1.0f), glm::mat4(1.0f));
+	if (finish_gl_) {
+		glFinish();
+	}
+	PROFILE_STOP(drawTimer);
 }
 
 void VideoOverlayApp::RenderTextureId() {
@@ -336,10 +391,86 @@ void VideoOverlayApp::RenderTextureId() {
 int VideoOverlayApp::LoadTargetModel(JNIEnv* env, jstring path) {
 
 	  const char* path_ = (const char*) env->GetStringUTFChars(path,NULL);
-	  int ret = processor_.loadModelFromFile(std::string(path_));
+	  int ret = LoadTargetModel(std::string(path_));
+	  env->ReleaseStringUTFChars(path,path_);
+	  return ret;
+}
+
+int VideoOverlayApp::LoadTargetModel(const std::string& path) {
+	  return processor_.loadModelFromFile(path);
+}
+
+int VideoOverlayApp::LoadTargetModelAsync(JNIEnv* env, jstring path) {
+
+	  const char* path_ = (const char*) env->GetStringUTFChars(path,NULL);
+	  int ret = processor_.loadModelFromFileAsync(std::string(path_));
 	  env->ReleaseStringUTFChars(path,path_);
 	  return ret;
 }
 
+bool VideoOverlayApp::IsTargetModelLoading() {
+	  return processor_.isModelLoading();
+}
+
+int VideoOverlayApp::GetTargetModelStatus() {
+	  return processor_.getModelLoadStatus();
+}
+
+int VideoOverlayApp::StartRecording(JNIEnv* env, jstring path) {
+
+	TangoCameraIntrinsics intrinsics;
+	if (TangoService_getCameraIntrinsics(TANGO_CAMERA_COLOR, &intrinsics) != TANGO_SUCCESS) {
+		LOGE("VideoOverlayApp: Failed to get camera intrinsics for recording");
+		return RET_FAILED;
+	}
+
+	recordingIntrinsics record;
+	memset(&record, 0, sizeof(record));
+	record.fx = intrinsics.fx;
+	record.fy = intrinsics.fy;
+	record.cx = intrinsics.cx;
+	record.cy = intrinsics.cy;
+	for (int i = 0; i < 5; i++) {
+		record.distortion[i] = intrinsics.distortion[i];
+	}
+	record.width = intrinsics.width;
+	record.height = intrinsics.height;
+	record.model = intrinsics.calibration_type;
+
+	// Frames are expected at the calibrated size; all buffers are
+	// allocated now, not on the camera thread.
+	recording_width_ = intrinsics.width;
+	recording_height_ = intrinsics.height;
+
+	const char* path_ = (const char*) env->GetStringUTFChars(path,NULL);
+	int ret = recorder_.start(std::string(path_), recording_width_, recording_height_,
+			&record);
+	env->ReleaseStringUTFChars(path,path_);
+	return ret;
+}
+
+void VideoOverlayApp::StopRecording() {
+	  recorder_.stop();
+}
+
+std::string VideoOverlayApp::GetProfileReport() {
+	  return profiler::report();
+}
+
+void VideoOverlayApp::ResetProfile() {
+	  profiler::reset();
+}
+
+void VideoOverlayApp::StartTrace() {
+	  profiler::startTrace();
+}
+
+int VideoOverlayApp::StopTrace(JNIEnv* env, jstring path) {
+	const char* path_ = (const char*) env->GetStringUTFChars(path,NULL);
+	int ret = profiler::stopTrace(std::string(path_));
+	env->ReleaseStringUTFChars(path,path_);
+	return ret;
+}
+
 }
 
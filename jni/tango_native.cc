@@ -91,6 +91,66 @@ Java_com_project_tango_TangoJNINative_loadTargetModel(
 
 }
 
+JNIEXPORT jint JNICALL
+Java_com_project_tango_TangoJNINative_loadTargetModelAsync(
+		JNIEnv* env, jobject, jstring path) {
+	return app.LoadTargetModelAsync(env, path);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_project_tango_TangoJNINative_isTargetModelLoading(
+		JNIEnv*, jobject) {
+	return app.IsTargetModelLoading();
+}
+
+JNIEXPORT jint JNICALL
+Java_com_project_tango_TangoJNINative_getTargetModelStatus(
+		JNIEnv*, jobject) {
+	return app.GetTargetModelStatus();
+}
+
+JNIEXPORT jint JNICALL
+Java_com_project_tango_TangoJNINative_startRecording(
+		JNIEnv* env, jobject, jstring path) {
+	return app.StartRecording(env, path);
+}
+
+JNIEXPORT void JNICALL
+Java_com_project_tango_TangoJNINative_stopRecording(
+		JNIEnv*, jobject) {
+	app.StopRecording();
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_project_tango_TangoJNINative_isRecording(
+		JNIEnv*, jobject) {
+	return app.IsRecording();
+}
+
+JNIEXPORT jstring JNICALL
+Java_com_project_tango_TangoJNINative_getProfileReport(
+		JNIEnv* env, jobject) {
+	return env->NewStringUTF(app.GetProfileReport().c_str());
+}
+
+JNIEXPORT void JNICALL
+Java_com_project_tango_TangoJNINative_resetProfile(
+		JNIEnv*, jobject) {
+	app.ResetProfile();
+}
+
+JNIEXPORT void JNICALL
+Java_com_project_tango_TangoJNINative_startTrace(
+		JNIEnv*, jobject) {
+	app.StartTrace();
+}
+
+JNIEXPORT jint JNICALL
+Java_com_project_tango_TangoJNINative_stopTrace(
+		JNIEnv* env, jobject, jstring path) {
+	return app.StopTrace(env, path);
+}
+
 #ifdef __cplusplus
 }
 #endif
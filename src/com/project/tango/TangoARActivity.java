@@ -30,6 +30,7 @@ import android.content.res.AssetManager;
 import android.graphics.PixelFormat;
 import android.opengl.GLSurfaceView;
 import android.os.Bundle;
+import android.os.Handler;
 import android.view.View;
 import android.widget.Toast;
 import android.widget.ToggleButton;
@@ -48,8 +49,33 @@ public class TangoARActivity extends Activity
   private static final int RET_FAILED 			= -1;
   private static final String TAG 				= "TangoAR-java";
   private static final String mModelFilename 	= "model.bin";
+  private static final int MODEL_POLL_MS 		= 200;
   private GLSurfaceView glView;
   private ToggleButton mYUVRenderSwitcher;
+  private ToggleButton mRecordSwitcher;
+  private String mTracePath;
+  private final Handler mHandler = new Handler();
+
+  // Report the outcome of the background model load once it is known
+  private final Runnable mModelStatusCheck = new Runnable() {
+    @Override
+    public void run() {
+      switch (TangoJNINative.getTargetModelStatus()) {
+      case TangoJNINative.MODEL_LOADING:
+        mHandler.postDelayed(this, MODEL_POLL_MS);
+        break;
+      case TangoJNINative.MODEL_LOAD_FAILED:
+        Log.i(TAG, "Unable to load model file \n");
+        Toast.makeText(getBaseContext(),
+            "Unable to load model!", Toast.LENGTH_SHORT).show();
+        break;
+      case TangoJNINative.MODEL_LOADED:
+        Toast.makeText(getBaseContext(),
+            "Model loaded", Toast.LENGTH_SHORT).show();
+        break;
+      }
+    }
+  };
 
   @Override
   protected void onCreate(Bundle savedInstanceState) {
@@ -62,6 +88,9 @@ public class TangoARActivity extends Activity
     mYUVRenderSwitcher = (ToggleButton) findViewById(R.id.yuv_switcher);
     mYUVRenderSwitcher.setOnClickListener(this);
 
+    mRecordSwitcher = (ToggleButton) findViewById(R.id.record_switcher);
+    mRecordSwitcher.setOnClickListener(this);
+
     // Copy model binary file from asset to sd card so that 
     // the native side can read it.
     ContextWrapper pContextW  = new ContextWrapper(this);
@@ -93,14 +122,14 @@ public class TangoARActivity extends Activity
     TangoJNINative.connect();    
 	
     // Load binary model containing visual description of the target.
-    if(loadBinaryModel() != RET_SUCCESS){
-    		Log.i(TAG, "Unable to load model file \n");
-    		Toast.makeText(getBaseContext(),
-    				"Unable to load model!", Toast.LENGTH_SHORT).show();
-    }else{
-    	Toast.makeText(getBaseContext(),
-    			"Model loaded ...", Toast.LENGTH_SHORT).show();
-    }
+    // The model is built in the background; frames are displayed
+    // without detection until it is ready. Its outcome is polled and
+    // shown when the load is done.
+    loadBinaryModel();
+    Toast.makeText(getBaseContext(),
+    		"Loading model ...", Toast.LENGTH_SHORT).show();
+    mHandler.removeCallbacks(mModelStatusCheck);
+    mHandler.postDelayed(mModelStatusCheck, MODEL_POLL_MS);
     
     EnableYUVTexture(mYUVRenderSwitcher.isChecked());
   }
@@ -109,6 +138,17 @@ public class TangoARActivity extends Activity
   protected void onPause() {
     super.onPause();
     glView.onPause();
+    mHandler.removeCallbacks(mModelStatusCheck);
+
+    // Latencies of the native pipeline over the session
+    Log.i(TAG, "Native latencies:\n" + TangoJNINative.getProfileReport());
+    TangoJNINative.resetProfile();
+
+    // Close the recording before the camera goes away
+    if (TangoJNINative.isRecording()) {
+      stopRecording();
+    }
+    mRecordSwitcher.setChecked(false);
     
     // Disconnect from Tango Service, release all the resources that the app is
     // holding from Tango Service.
@@ -122,6 +162,9 @@ public class TangoARActivity extends Activity
     case R.id.yuv_switcher:
       EnableYUVTexture(mYUVRenderSwitcher.isChecked());
       break;
+    case R.id.record_switcher:
+      EnableRecording(mRecordSwitcher.isChecked());
+      break;
     }
   }
 
@@ -139,10 +182,43 @@ public class TangoARActivity extends Activity
       }
   }
 
+  // Record camera frames and poses to a new file in the app storage,
+  // to be replayed offline (tools/replay), and a Chrome trace of the
+  // native pipeline next to it
+  private void EnableRecording(boolean isEnabled) {
+    if (!isEnabled) {
+      stopRecording();
+      return;
+    }
+    File dir = getExternalFilesDir(null);
+    if (dir == null) {
+      dir = getFilesDir();
+    }
+    String path = dir.getAbsolutePath() + "/capture_" + System.currentTimeMillis() + ".rec";
+    if (TangoJNINative.startRecording(path) != RET_SUCCESS) {
+      mRecordSwitcher.setChecked(false);
+      Toast.makeText(getBaseContext(),
+          "Unable to start recording!", Toast.LENGTH_SHORT).show();
+    } else {
+      mTracePath = path.replace(".rec", ".json");
+      TangoJNINative.startTrace();
+      Toast.makeText(getBaseContext(),
+          "Recording to " + path, Toast.LENGTH_SHORT).show();
+    }
+  }
+
+  private void stopRecording() {
+    TangoJNINative.stopRecording();
+    if (mTracePath != null) {
+      TangoJNINative.stopTrace(mTracePath);
+      mTracePath = null;
+    }
+  }
+
   private int loadBinaryModel(){
 		ContextWrapper cw = new ContextWrapper(getBaseContext());
 		String path = cw.getFilesDir().getAbsolutePath();		
-		return TangoJNINative.loadTargetModel(path + "/" + mModelFilename);
+		return TangoJNINative.loadTargetModelAsync(path + "/" + mModelFilename);
   }
   
   private void copyAssets(String outputPath) {
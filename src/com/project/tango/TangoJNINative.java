@@ -70,4 +70,42 @@ public class TangoJNINative {
   // Load binary file containing target model
   public static native int loadTargetModel(String path);
 
+  // Load binary file containing target model on a background thread.
+  // Returns immediately; detection starts once the model is ready.
+  public static native int loadTargetModelAsync(String path);
+
+  // True while a background model load is running
+  public static native boolean isTargetModelLoading();
+
+  // Outcome of the last background model load: MODEL_LOAD_NONE,
+  // MODEL_LOADING, MODEL_LOADED or MODEL_LOAD_FAILED
+  public static final int MODEL_LOAD_NONE   = 0;
+  public static final int MODEL_LOADING     = 1;
+  public static final int MODEL_LOADED      = 2;
+  public static final int MODEL_LOAD_FAILED = 3;
+  public static native int getTargetModelStatus();
+
+  // Record camera frames, intrinsics and device poses to a file.
+  // Frames are written by a background thread.
+  public static native int startRecording(String path);
+
+  // Stop recording and close the file
+  public static native void stopRecording();
+
+  // True while recording
+  public static native boolean isRecording();
+
+  // Latency percentiles of the instrumented native code paths
+  // (processFrame stages, estimateH, RenderYUV), as a text table
+  public static native String getProfileReport();
+
+  // Clear the latency histograms
+  public static native void resetProfile();
+
+  // Keep a timeline of the instrumented native code paths, tagged with
+  // camera frame ids, until stopTrace() writes it as Chrome trace JSON
+  // (chrome://tracing or ui.perfetto.dev)
+  public static native void startTrace();
+  public static native int stopTrace(String path);
+
 }
@@ -0,0 +1,376 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ *
+ * Checks that frameProcessor::processFrame does not touch the heap once
+ * warmed up (frame_arena.h and the buffers kept across frames).
+ *
+ *     alloc_check [-frames n] [-warmup n]
+ *
+ * malloc and its relatives are replaced by counting versions that
+ * forward to glibc (operator new of libstdc++ allocates with malloc).
+ * A synthetic target seen under a few poses is processed with every
+ * matcher: by feature, by bucket, with multi-probe and through the MIH
+ * index. Each one is warmed up for -warmup (3) passes over the poses,
+ * then the allocations made during the next -frames (50) frames are
+ * counted and their call sites resolved. Every allocation fails the
+ * check (exit status 1), in the processor or in a library it calls,
+ * except those made inside the OpenCV calls of exemptCalls: cv::FAST
+ * and cv::resize allocate scratch rows sized by the image on every call,
+ * which no caller can provide. They are listed as exempt. OpenCV must be
+ * linked as shared libraries to be told apart.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <cxxabi.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/frame_processor.h"
+#include "synthetic_texture.h"
+
+using namespace cv;
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t num, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t align, size_t size);
+void  __libc_free(void* ptr);
+}
+
+namespace {
+
+#define MAX_SITES		128		// Distinct call stacks kept
+#define SITE_DEPTH		16		// Frames kept per call stack
+#define HOOK_FRAMES		2		// recordAlloc and the malloc replacement
+
+/**
+* Library functions called by processFrame that may allocate, as the
+* start of their demangled names
+*/
+const char* const exemptCalls[] = {
+	"cv::FAST(",		// rolling score and corner rows (AutoBuffer)
+	"cv::resize(",		// INTER_AREA interpolation tables
+};
+
+/**
+* Call stack of an allocation and the number of allocations made there
+*/
+struct allocSite {
+	void*		frames[SITE_DEPTH];
+	int			depth;
+	uint64_t	count;
+};
+
+std::atomic<bool>		armed(false);
+std::atomic<uint64_t>	numAllocs(0);
+std::atomic_flag		siteLock = ATOMIC_FLAG_INIT;
+allocSite				sites[MAX_SITES];
+int						numSites = 0;
+
+// Set while the hook itself runs (backtrace may allocate)
+__thread bool inHook = false;
+
+/**
+* Count an allocation and record its call stack. Called by every
+* replacement below; nothing here may allocate.
+*/
+__attribute__((noinline)) void recordAlloc(void)
+{
+	if(!armed.load(std::memory_order_relaxed) || inHook){
+		return;
+	}
+	inHook = true;
+	numAllocs++;
+
+	void* frames[SITE_DEPTH + HOOK_FRAMES];
+	int depth = backtrace(frames, SITE_DEPTH + HOOK_FRAMES) - HOOK_FRAMES;
+	if(depth > 0){
+		while(siteLock.test_and_set(std::memory_order_acquire));
+		int s;
+		for(s = 0; s < numSites; s++){
+			if(sites[s].depth == depth &&
+			   !memcmp(sites[s].frames, frames + HOOK_FRAMES, depth * sizeof(void*))){
+				break;
+			}
+		}
+		if(s < numSites){
+			sites[s].count++;
+		}else if(numSites < MAX_SITES){
+			memcpy(sites[s].frames, frames + HOOK_FRAMES, depth * sizeof(void*));
+			sites[s].depth = depth;
+			sites[s].count = 1;
+			numSites++;
+		}
+		siteLock.clear(std::memory_order_release);
+	}
+	inHook = false;
+}
+
+// Object file and demangled symbol of a code address
+void describeAddress(void* address, std::string& object, std::string& symbol)
+{
+	Dl_info info;
+	object = symbol = "?";
+	if(!dladdr(address, &info)){
+		return;
+	}
+	if(info.dli_fname){
+		const char* slash = strrchr(info.dli_fname, '/');
+		object = slash ? slash + 1 : info.dli_fname;
+	}
+	if(info.dli_sname){
+		int status;
+		char* name = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+		symbol = status == 0 ? name : info.dli_sname;
+		free(name);
+	}
+}
+
+// True for the C and C++ runtimes, which only pass allocations through
+bool isRuntime(const std::string& object)
+{
+	return !object.compare(0, 5, "libc.") || !object.compare(0, 5, "libm.") ||
+		   !object.compare(0, 9, "libstdc++") || !object.compare(0, 8, "libgcc_s") ||
+		   !object.compare(0, 10, "libpthread");
+}
+
+// True if "caller" is one of exemptCalls
+bool isExempt(const std::string& caller)
+{
+	for(size_t i = 0; i < sizeof(exemptCalls) / sizeof(exemptCalls[0]); i++){
+		if(!caller.compare(0, strlen(exemptCalls[i]), exemptCalls[i])){
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+* Report the allocations recorded since arming. A site belongs to the
+* first object of its stack outside the runtimes: a library, or this
+* executable (the processor is linked in statically). Returns the number
+* of allocations that are not exempt.
+*/
+uint64_t reportSites(const std::string& self)
+{
+	uint64_t failed = 0;
+	for(int s = 0; s < numSites; s++){
+		const allocSite& site = sites[s];
+		std::string object, symbol;
+		int f;
+		for(f = 0; f < site.depth; f++){
+			describeAddress(site.frames[f], object, symbol);
+			if(!isRuntime(object)){
+				break;
+			}
+		}
+		if(f == site.depth){
+			continue;
+		}
+
+		if(object == self){
+			failed += site.count;
+			printf("  %8llu  processor: %s\n", (unsigned long long)site.count, symbol.c_str());
+			fflush(stdout);
+			backtrace_symbols_fd(const_cast<void* const*>(site.frames), site.depth, 1);
+			continue;
+		}
+
+		// Library function called by the processor
+		std::string caller = symbol, callerObject;
+		for(f++; f < site.depth; f++){
+			std::string name;
+			describeAddress(site.frames[f], callerObject, name);
+			if(callerObject == self){
+				break;
+			}
+			caller = name;
+		}
+		bool exempt = isExempt(caller);
+		failed += exempt ? 0 : site.count;
+		printf("  %8llu  %s: %s (in %s)%s\n", (unsigned long long)site.count,
+			   object.c_str(), caller.c_str(), symbol.c_str(), exempt ? ", exempt" : "");
+	}
+	return failed;
+}
+
+/**
+* Matcher settings checked in turn
+*/
+struct matcherConfig {
+	const char*	name;
+	matchMode	mode;
+	int			probes;
+	int			mihSubstrings;
+};
+
+const matcherConfig configs[] = {
+	{"feature",		MATCH_BY_FEATURE,	0,			0},
+	{"bucket",		MATCH_BY_BUCKET,	0,			0},
+	{"multi-probe",	MATCH_BY_BUCKET,	MAX_PROBES,	0},
+	{"mih",			MATCH_BY_FEATURE,	0,			16},
+};
+
+void usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-frames n] [-warmup n]\n", name);
+	exit(1);
+}
+
+}  // namespace
+
+/**
+* Counting replacements of the glibc allocator
+*/
+extern "C" {
+
+void* malloc(size_t size)
+{
+	recordAlloc();
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t num, size_t size)
+{
+	recordAlloc();
+	return __libc_calloc(num, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+	recordAlloc();
+	return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t align, size_t size)
+{
+	recordAlloc();
+	return __libc_memalign(align, size);
+}
+
+void* aligned_alloc(size_t align, size_t size)
+{
+	recordAlloc();
+	return __libc_memalign(align, size);
+}
+
+int posix_memalign(void** ptr, size_t align, size_t size)
+{
+	recordAlloc();
+	*ptr = __libc_memalign(align, size);
+	return *ptr ? 0 : ENOMEM;
+}
+
+void free(void* ptr)
+{
+	__libc_free(ptr);
+}
+
+}  // extern "C"
+
+int main(int argc, char** argv)
+{
+	int numFrames = 50, numWarmup = 3;
+	for(int arg = 1; arg < argc; arg++){
+		std::string opt = argv[arg];
+		if(arg + 1 >= argc){
+			usage(argv[0]);
+		}
+		if(opt == "-frames"){
+			numFrames = atoi(argv[++arg]);
+		}else if(opt == "-warmup"){
+			numWarmup = atoi(argv[++arg]);
+		}else{
+			usage(argv[0]);
+		}
+	}
+
+	// backtrace() loads its unwinder on first use: do it before arming
+	void* stack[4];
+	backtrace(stack, 4);
+	std::string self, symbol;
+	describeAddress((void*)&usage, self, symbol);
+
+	/**
+	 * Target 0 warped onto a random background under a few poses
+	 */
+	RNG rng(1234);
+	Size targetSize(320, 240);
+	Mat target = randomTexture(targetSize, rng);
+	Mat background = randomTexture(Size(640, 480), rng);
+	Point2f src[4] = {Point2f(0, 0), Point2f(320, 0), Point2f(320, 240), Point2f(0, 240)};
+	Point2f base[4] = {Point2f(170, 130), Point2f(480, 110), Point2f(470, 370), Point2f(160, 350)};
+
+	std::vector<Mat> frames;
+	for(int p = 0; p < 4; p++){
+		Point2f dst[4];
+		for(int c = 0; c < 4; c++){
+			dst[c] = base[c] + Point2f(rng.uniform(-20.f, 20.f), rng.uniform(-20.f, 20.f));
+		}
+		Mat H = getPerspectiveTransform(src, dst);
+		Mat frame = background.clone(), warped, mask, rgb;
+		warpPerspective(target, warped, H, frame.size());
+		warpPerspective(Mat(targetSize, CV_8UC1, Scalar::all(255)), mask, H, frame.size());
+		warped.copyTo(frame, mask);
+		cvtColor(frame, rgb, CV_GRAY2RGB);
+		frames.push_back(rgb);
+	}
+
+	frameProcessor processor;
+	modelDatabase model;
+	std::vector<Feature> features;
+	std::vector<std::vector<uint32_t> > indexTbl(INDEX_TABLE_SIZE);
+	processor.extractFeatures(target, features);
+	for(uint32_t i = 0; i < features.size(); i++){
+		indexTbl[features[i].index].push_back(i);
+	}
+	if(model.addTarget(targetSize, features, indexTbl) < 0){
+		fprintf(stderr, "Error: could not build the model\n");
+		return 1;
+	}
+
+	uint64_t totalFailed = 0;
+	Mat output;
+	for(size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++){
+		const matcherConfig& config = configs[c];
+		std::shared_ptr<modelDatabase> snapshot = std::make_shared<modelDatabase>(model);
+		snapshot->setMIHSubstrings(config.mihSubstrings);
+		processor.setModel(snapshot);
+		processor.setMatchMode(config.mode);
+		processor.setProbeBudget(config.probes);
+
+		for(size_t f = 0; f < numWarmup * frames.size(); f++){
+			processor.processFrame(frames[f % frames.size()], output);
+		}
+
+		numSites = 0;
+		numAllocs = 0;
+		armed = true;
+		uint32_t numDetections = 0;
+		for(int f = 0; f < numFrames; f++){
+			processor.processFrame(frames[f % frames.size()], output);
+			numDetections += processor.getDetections().size();
+		}
+		armed = false;
+
+		printf("%s: %llu allocations in %d frames (target found in %u)\n", config.name,
+			   (unsigned long long)numAllocs.load(), numFrames, numDetections);
+		totalFailed += reportSites(self);
+	}
+
+	if(totalFailed){
+		printf("FAIL: %llu allocations after warm-up outside the exempt OpenCV calls\n",
+			   (unsigned long long)totalFailed);
+		return 1;
+	}
+	printf("PASS: no allocation after warm-up outside the exempt OpenCV calls\n");
+	return 0;
+}
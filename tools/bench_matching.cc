@@ -0,0 +1,306 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ *
+ * Scalability of descriptor matching with the size of the model.
+ *
+ * Synthetic models of 1k up to 1M features are built as catalogues of
+ * targets of 1000 random features each. Features are spread over the
+ * hash buckets with a Zipf law (exponent -skew) over a random order of
+ * the buckets, as real patch hashes are: a few buckets hold most of the
+ * features. The same query set is matched against every model: half the
+ * queries are copies of features of the first target with a few bits
+ * flipped (they have a true match in every model), half are random
+ * descriptors in buckets drawn from the same law.
+ *
+ * Queries go through frameProcessor::matchFeatures(), i.e. the matcher
+ * of processFrame, by feature, by bucket, and through MIH with -mih.
+ * One CSV line is printed per model size and matcher:
+ *
+ *     qps          queries matched per second
+ *     cand/q       descriptor comparisons per query
+ *     words/q      32-bit descriptor words read per query
+ *     llc_miss/q   last-level cache misses per query (perf_event, empty
+ *                  when the kernel does not give access to the counter)
+ *     matched      fraction of the queries with a match
+ *
+ * cand/q and words/q are zero in a build with TANGO_MATCH_STATS=0.
+ *
+ *     bench_matching [-max features] [-queries n] [-bits b] [-skew s]
+ *                    [-mih 16|32]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/frame_processor.h"
+
+using namespace cv;
+
+namespace {
+
+typedef std::chrono::steady_clock timer;
+
+const uint32_t FEATURES_PER_TARGET = 1000;
+const double   MIN_SECONDS		   = 0.2;	// Timed matching per model and matcher
+
+/**
+* Last-level cache misses of the calling thread, in user space
+*/
+class llcCounter {
+public:
+	llcCounter() : fd(-1) {
+#ifdef __linux__
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size			= sizeof(attr);
+		attr.disabled		= 1;
+		attr.exclude_kernel	= 1;
+		attr.exclude_hv		= 1;
+
+		// LLC read misses, or the generic cache-miss event (LLC on x86)
+		attr.type	= PERF_TYPE_HW_CACHE;
+		attr.config	= PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+					  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if(fd < 0){
+			attr.type	= PERF_TYPE_HARDWARE;
+			attr.config	= PERF_COUNT_HW_CACHE_MISSES;
+			fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+#endif
+	}
+	~llcCounter() {
+		if(fd >= 0){
+			close(fd);
+		}
+	}
+
+	bool valid(void) const { return fd >= 0; }
+
+	void start(void) {
+#ifdef __linux__
+		if(fd >= 0){
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	uint64_t stop(void) {
+		uint64_t count = 0;
+#ifdef __linux__
+		if(fd >= 0){
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			if(read(fd, &count, sizeof(count)) != sizeof(count)){
+				count = 0;
+			}
+		}
+#endif
+		return count;
+	}
+
+private:
+	int fd;
+};
+
+/**
+* Zipf law over the buckets, most popular bucket at a random position
+*/
+class bucketLaw {
+public:
+	bucketLaw(uint32_t numBuckets, double exponent, std::mt19937& rng) :
+		cdf(numBuckets), order(numBuckets) {
+		double sum = 0;
+		for(uint32_t i = 0; i < numBuckets; i++){
+			sum += pow(i + 1.0, -exponent);
+			cdf[i] = sum;
+			order[i] = i;
+		}
+		for(uint32_t i = 0; i < numBuckets; i++){
+			cdf[i] /= sum;
+		}
+		std::shuffle(order.begin(), order.end(), rng);
+	}
+
+	uint32_t draw(std::mt19937& rng) const {
+		double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+		size_t rank = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+		return order[std::min(rank, order.size() - 1)];
+	}
+
+private:
+	std::vector<double> cdf;
+	std::vector<uint32_t> order;
+};
+
+void randomDescriptor(std::mt19937& rng, uint32_t* descriptor)
+{
+	for(int w = 0; w < DESCRIPTOR_SIZE; w++){
+		descriptor[w] = rng();
+	}
+}
+
+// One target of FEATURES_PER_TARGET random features
+void addRandomTarget(modelDatabase& model, const bucketLaw& law, uint32_t numBuckets,
+					 std::mt19937& rng, std::vector<Feature>& features)
+{
+	std::vector<std::vector<uint32_t> > indexTbl(numBuckets);
+	features.resize(FEATURES_PER_TARGET);
+	for(uint32_t i = 0; i < FEATURES_PER_TARGET; i++){
+		randomDescriptor(rng, features[i].descriptor);
+		features[i].x	  = rng() % 640;
+		features[i].y	  = rng() % 480;
+		features[i].index = law.draw(rng);
+		indexTbl[features[i].index].push_back(i);
+	}
+	model.addTarget(Size(640, 480), features, indexTbl);
+}
+
+void usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-max features] [-queries n] [-bits b] [-skew s] "
+			"[-mih 16|32]\n", name);
+	exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	uint32_t maxFeatures = 1000000, numQueries = 2000;
+	int hashBits = DEFAULT_HASH_BITS, mihSubstrings = 0;
+	double skew = 0.8;
+
+	for(int arg = 1; arg < argc; arg++){
+		std::string opt = argv[arg];
+		if(arg + 1 >= argc){
+			usage(argv[0]);
+		}
+		const char* value = argv[++arg];
+		if(opt == "-max"){
+			maxFeatures = strtoul(value, NULL, 10);
+		}else if(opt == "-queries"){
+			numQueries = std::max(2, atoi(value));
+		}else if(opt == "-bits"){
+			hashBits = atoi(value);
+		}else if(opt == "-skew"){
+			skew = atof(value);
+		}else if(opt == "-mih"){
+			mihSubstrings = atoi(value);
+		}else{
+			usage(argv[0]);
+		}
+	}
+	if(hashBits < MIN_HASH_BITS || hashBits > MAX_HASH_BITS){
+		fprintf(stderr, "Error: -bits must be %d to %d\n", MIN_HASH_BITS, MAX_HASH_BITS);
+		return 1;
+	}
+	uint32_t numBuckets = 1u << hashBits;
+
+	std::mt19937 rng(1234);
+	bucketLaw law(numBuckets, skew, rng);
+	modelDatabase model;
+	std::vector<Feature> firstTarget, features;
+	addRandomTarget(model, law, numBuckets, rng, firstTarget);
+
+	/**
+	 * Fixed query set: near copies of features of the first target, and
+	 * random descriptors
+	 */
+	descriptorArray queryDescriptors(numQueries);
+	std::vector<featureLocation> queryLocations(numQueries);
+	std::vector<uint32_t> queryIndices(numQueries);
+	for(uint32_t q = 0; q < numQueries; q++){
+		uint32_t* bits = queryDescriptors[q].bits;
+		if(q % 2 == 0){
+			const Feature& f = firstTarget[rng() % firstTarget.size()];
+			memcpy(bits, f.descriptor, sizeof(f.descriptor));
+			for(int k = rng() % 16; k > 0; k--){
+				int bit = rng() % DESCRIPTOR_LENGTH;
+				bits[bit / 32] ^= 1u << (bit % 32);
+			}
+			queryIndices[q] = f.index;
+		}else{
+			randomDescriptor(rng, bits);
+			queryIndices[q] = law.draw(rng);
+		}
+		queryLocations[q].x = rng() % 640;
+		queryLocations[q].y = rng() % 480;
+	}
+	featureSet queries = {queryDescriptors.data(), &queryLocations[0], &queryIndices[0]};
+
+	const char* names[] = {"feature", "bucket", "mih"};
+	int numMatchers = mihSubstrings ? 3 : 2;
+	llcCounter llc;
+	if(!llc.valid()){
+		fprintf(stderr, "Warning: no access to the LLC miss counter (perf_event_paranoid?)\n");
+	}
+
+	printf("matcher,features,targets,buckets,max_bucket,queries,qps,cand_per_query,"
+		   "words_per_query,llc_miss_per_query,matched\n");
+
+	const uint32_t steps[] = {1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000,
+							  500000, 1000000, 2000000, 5000000, 10000000};
+	frameProcessor processor;
+	for(size_t s = 0; s < sizeof(steps) / sizeof(steps[0]) && steps[s] <= maxFeatures; s++){
+		if(steps[s] / FEATURES_PER_TARGET > MAX_NUM_TARGETS){
+			break;
+		}
+		while(model.numFeatures() < steps[s]){
+			addRandomTarget(model, law, numBuckets, rng, features);
+		}
+		size_t maxBucket = 0;
+		for(uint32_t b = 0; b < numBuckets; b++){
+			maxBucket = std::max(maxBucket, model.bucket(b).size());
+		}
+
+		for(int m = 0; m < numMatchers; m++){
+			std::shared_ptr<modelDatabase> snapshot = std::make_shared<modelDatabase>(model);
+			snapshot->setMIHSubstrings(m == 2 ? mihSubstrings : 0);
+			processor.setModel(snapshot);
+			processor.setMatchMode(m == 1 ? MATCH_BY_BUCKET : MATCH_BY_FEATURE);
+
+			// Warm-up, then repeat the query set for at least MIN_SECONDS
+			uint32_t numMatched = processor.matchFeatures(queries, NULL, numQueries);
+			processor.resetMatchStats();
+
+			uint64_t numPasses = 0, misses = 0;
+			timer::time_point start = timer::now();
+			double seconds = 0;
+			while(seconds < MIN_SECONDS){
+				llc.start();
+				processor.matchFeatures(queries, NULL, numQueries);
+				misses += llc.stop();
+				numPasses++;
+				seconds = std::chrono::duration<double>(timer::now() - start).count();
+			}
+
+			double total = (double)numPasses * numQueries;
+			const matchStats& stats = processor.getMatchStats();
+			char missText[32] = "";
+			if(llc.valid()){
+				snprintf(missText, sizeof(missText), "%.2f", misses / total);
+			}
+			printf("%s,%u,%u,%u,%zu,%u,%.0f,%.1f,%.1f,%s,%.3f\n", names[m],
+				   model.numFeatures(), model.numTargets(), numBuckets, maxBucket,
+				   numQueries, total / seconds, stats.candidates / total,
+				   stats.words / total, missText, (double)numMatched / numQueries);
+			fflush(stdout);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,236 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ *
+ * Candidate filters for descriptor matching: the 13-bit patch hash
+ * index (indexTbl), with and without multi-probe, against multi-index
+ * hashing (MIH) over 16 and 32 descriptor substrings.
+ *
+ * The model is built from the upright target image (a random texture,
+ * or the image given on the command line). Queries are the features of
+ * random perspective views of it. For every query the reference is the
+ * nearest model feature within MIN_HAMMING_DIST found by a linear scan:
+ *
+ *     recall   fraction of the queries with a reference for which the
+ *              filter returns the reference distance
+ *     correct  fraction of the returned matches that land within 3 px
+ *              of the true location in the target
+ *     cand/q   descriptor comparisons per query
+ *     ns/q     time per query
+ *
+ *     bench_mih [target image] [views]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/frame_processor.h"
+#include "synthetic_texture.h"
+#include "tango-video-handler/mih_index.h"
+
+using namespace cv;
+
+namespace {
+
+struct query {
+	Feature  feature;
+	uint32_t probes[MAX_PROBES];
+	Point2f  truth;			// Location in the target image
+};
+
+struct result {
+	int      distance;		// MIN_HAMMING_DIST + 1 if no match
+	uint32_t idx;
+};
+
+// Random mild perspective view of the target, with its homography
+Mat randomView(const Mat& target, RNG& rng, Mat& H)
+{
+	float w = target.cols, h = target.rows, j = 0.1f;
+	Point2f src[4] = {Point2f(0, 0), Point2f(w, 0), Point2f(w, h), Point2f(0, h)};
+	Point2f dst[4];
+	for(int i = 0; i < 4; i++){
+		dst[i] = Point2f(src[i].x + rng.uniform(-j, j) * w + 0.1f * w,
+						 src[i].y + rng.uniform(-j, j) * h + 0.1f * h);
+	}
+	H = getPerspectiveTransform(src, dst);
+	Mat view;
+	warpPerspective(target, view, H, Size(w * 1.2f, h * 1.2f));
+	return view;
+}
+
+// Nearest model feature in the given buckets
+result bucketLookup(const modelDatabase& model, const query& q, int numProbes,
+					uint64_t& candidates, uint64_t& words)
+{
+	result r = {MIN_HAMMING_DIST + 1, 0};
+	for(int p = 0; p <= numProbes; p++){
+		uint32_t bucket = p ? q.probes[p - 1] : q.feature.index;
+		if(bucket == NO_PROBE){
+			break;
+		}
+		const std::vector<uint32_t>& tbl = model.bucket(bucket);
+		for(size_t j = 0; j < tbl.size(); j++){
+			int dist = descriptorDistance(q.feature.descriptor,
+										  model.descriptor(tbl[j]).bits, r.distance, words);
+			if(dist < r.distance){
+				r.distance = dist;
+				r.idx	   = tbl[j];
+			}
+		}
+		candidates += tbl.size();
+	}
+	return r;
+}
+
+void report(const char* name, const std::vector<query>& queries,
+			const std::vector<result>& reference, const std::vector<result>& found,
+			const std::vector<Feature>& features, uint64_t candidates, double seconds)
+{
+	uint32_t numReference = 0, numRecalled = 0, numFound = 0, numCorrect = 0;
+	for(size_t i = 0; i < queries.size(); i++){
+		if(reference[i].distance <= MIN_HAMMING_DIST){
+			numReference++;
+			numRecalled += found[i].distance == reference[i].distance;
+		}
+		if(found[i].distance <= MIN_HAMMING_DIST){
+			const Feature& f = features[found[i].idx];
+			Point2f d = Point2f(f.x, f.y) - queries[i].truth;
+			numFound++;
+			numCorrect += d.x * d.x + d.y * d.y <= 9.f;
+		}
+	}
+	printf("%-18s recall %6.3f  correct %6.3f  cand/q %8.1f  ns/q %9.1f\n", name,
+		   numReference ? (double)numRecalled / numReference : 0.0,
+		   numFound ? (double)numCorrect / numFound : 0.0,
+		   (double)candidates / queries.size(), seconds * 1e9 / queries.size());
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	RNG rng(1234);
+	Mat target = argc > 1 ? imread(argv[1], 0) : randomTexture(Size(640, 480), rng);
+	int numViews = argc > 2 ? atoi(argv[2]) : 20;
+	if(target.empty()){
+		fprintf(stderr, "Error: could not read %s\n", argv[1]);
+		return 1;
+	}
+
+	frameProcessor processor;
+	processor.setProbeBudget(MAX_PROBES);
+
+	/**
+	 * Model from the upright image, indexed both ways
+	 */
+	std::vector<Feature> features;
+	std::vector<std::vector<uint32_t> > indexTbl(INDEX_TABLE_SIZE);
+	processor.extractFeatures(target, features);
+	for(uint32_t i = 0; i < features.size(); i++){
+		indexTbl[features[i].index].push_back(i);
+	}
+	if(features.empty()){
+		fprintf(stderr, "Error: no features on the target\n");
+		return 1;
+	}
+	modelDatabase model;
+	model.addTarget(target.size(), features, indexTbl);
+
+	mihIndex mih16, mih32;
+	mih16.build(model.descriptors(), model.numFeatures(), 16);
+	mih32.build(model.descriptors(), model.numFeatures(), 32);
+
+	/**
+	 * Queries from random views, with their true location in the target
+	 */
+	std::vector<query> queries;
+	for(int v = 0; v < numViews; v++){
+		Mat H, Hinv;
+		Mat view = randomView(target, rng, H);
+		invert(H, Hinv);
+
+		std::vector<Feature> viewFeatures;
+		processor.extractFeatures(view, viewFeatures);
+		std::vector<Point2f> pts(viewFeatures.size()), truth;
+		for(size_t i = 0; i < viewFeatures.size(); i++){
+			pts[i] = Point2f(viewFeatures[i].x, viewFeatures[i].y);
+		}
+		if(pts.empty()){
+			continue;
+		}
+		perspectiveTransform(pts, truth, Hinv);
+
+		for(size_t i = 0; i < viewFeatures.size(); i++){
+			query q;
+			q.feature = viewFeatures[i];
+			q.truth	  = truth[i];
+			processor.calcHashIndex(view, Point(q.feature.x, q.feature.y), q.probes);
+			queries.push_back(q);
+		}
+	}
+	printf("%zu model features, %zu queries from %d views\n",
+		   features.size(), queries.size(), numViews);
+
+	std::vector<result> reference(queries.size()), found(queries.size());
+	std::vector<uint32_t> stamps(features.size(), 0);
+	uint64_t candidates, words;
+	std::chrono::steady_clock::time_point start;
+
+	/**
+	 * Linear scan (reference)
+	 */
+	candidates = words = 0;
+	start = std::chrono::steady_clock::now();
+	for(size_t i = 0; i < queries.size(); i++){
+		result r = {MIN_HAMMING_DIST + 1, 0};
+		for(uint32_t j = 0; j < features.size(); j++){
+			int dist = descriptorDistance(queries[i].feature.descriptor,
+										  features[j].descriptor, r.distance, words);
+			if(dist < r.distance){
+				r.distance = dist;
+				r.idx	   = j;
+			}
+		}
+		reference[i] = r;
+	}
+	candidates = (uint64_t)queries.size() * features.size();
+	report("linear", queries, reference, reference, features, candidates,
+		   std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+	/**
+	 * Patch hash index, plain and multi-probe
+	 */
+	for(int numProbes = 0; numProbes <= MAX_PROBES; numProbes += MAX_PROBES){
+		candidates = words = 0;
+		start = std::chrono::steady_clock::now();
+		for(size_t i = 0; i < queries.size(); i++){
+			found[i] = bucketLookup(model, queries[i], numProbes, candidates, words);
+		}
+		report(numProbes ? "indexTbl+probes" : "indexTbl", queries, reference, found,
+			   features, candidates,
+			   std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	/**
+	 * Multi-index hashing (exact within MIN_HAMMING_DIST)
+	 */
+	const mihIndex* mihs[2] = {&mih16, &mih32};
+	const char* names[2] = {"mih m=16", "mih m=32"};
+	for(int k = 0; k < 2; k++){
+		std::fill(stamps.begin(), stamps.end(), 0);
+		candidates = words = 0;
+		start = std::chrono::steady_clock::now();
+		for(size_t i = 0; i < queries.size(); i++){
+			found[i].distance = mihs[k]->nearest(queries[i].feature.descriptor, MIN_HAMMING_DIST,
+												 model.descriptors(), &stamps[0], i + 1, found[i].idx,
+												 candidates, words);
+		}
+		report(names[k], queries, reference, found, features, candidates,
+			   std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	}
+	return 0;
+}
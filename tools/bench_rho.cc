@@ -0,0 +1,363 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ *
+ * Synthetic benchmark of the RHO homography estimator.
+ *
+ * Every trial draws a random homography (rotation, scale, translation and
+ * a mild perspective) and N correspondences: inliers are mapped through
+ * it with Gaussian noise, outliers land anywhere in the image. Matches
+ * are then ordered by a score mixing inlierness and chance, so that
+ * ordering 1 puts every inlier first (ideal PROSAC input) and ordering 0
+ * is a random order (plain RANSAC input).
+ *
+ * Each scenario is run through rhoRefC with every flag combination and,
+ * when built with OpenCV, through cv::findHomography (RANSAC, and RHO on
+ * OpenCV 3) with the same threshold, iteration cap and confidence. One
+ * CSV line is printed per scenario and method:
+ *
+ *     time_us     p50/p95/mean time per call
+ *     iterations  mean PROSAC iterations (rhoRefC only)
+ *     found       fraction of the trials returning a homography
+ *     reproj_px   mean RMS distance between the true and the estimated
+ *                 projections of the inliers, over the found homographies
+ *
+ *     bench_rho [-trials n] [-seed s] [-n N] [-inliers r] [-sigma s]
+ *               [-ordering q]
+ *
+ * Without options the default grid of N, inlier ratio, noise and ordering
+ * is swept; each option fixes one axis.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include "tango-video-handler/param.h"
+#include "rhorefc.h"
+#include "percentile.h"
+#ifdef BENCH_RHO_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock timer;
+
+const float IMAGE_WIDTH	 = 640.f;
+const float IMAGE_HEIGHT = 480.f;
+
+struct scenario {
+	unsigned n;				// Correspondences
+	double	 inlierRatio;
+	double	 sigma;			// Inlier noise in pixels
+	double	 ordering;		// PROSAC ordering quality, 0 to 1
+};
+
+struct trial {
+	float H[9];				// True homography
+	std::vector<float> src, dst;	// Sorted correspondences (x, y)
+	std::vector<char>  inlier;		// Ground truth, in the same order
+};
+
+struct method {
+	std::string	name;
+	unsigned	flags;		// RHO flags, or ~0 for OpenCV
+	int			cvMethod;
+};
+
+struct result {
+	std::vector<uint64_t> ns;
+	uint64_t iterations;
+	uint32_t found;
+	double	 reprojSum;
+
+	result() : iterations(0), found(0), reprojSum(0) {}
+};
+
+void project(const float* H, float x, float y, float& X, float& Y)
+{
+	float z = H[6] * x + H[7] * y + H[8];
+	X = (H[0] * x + H[1] * y + H[2]) / z;
+	Y = (H[3] * x + H[4] * y + H[5]) / z;
+}
+
+// Random similarity with a mild perspective, keeping the image in view
+void randomHomography(std::mt19937& rng, float* H)
+{
+	std::uniform_real_distribution<float> u(-1.f, 1.f);
+	float a = 0.5f * u(rng), s = 1.f + 0.2f * u(rng);
+	float cx = IMAGE_WIDTH / 2, cy = IMAGE_HEIGHT / 2;
+	float c = s * cosf(a), d = s * sinf(a);
+	float p = 2e-4f * u(rng), q = 2e-4f * u(rng);
+
+	// Rotate and scale about the image center, then tilt
+	H[0] = c;		H[1] = -d;		H[2] = cx - c * cx + d * cy + 30.f * u(rng);
+	H[3] = d;		H[4] = c;		H[5] = cy - d * cx - c * cy + 30.f * u(rng);
+	H[6] = p;		H[7] = q;		H[8] = 1.f;
+}
+
+void makeTrial(const scenario& sc, std::mt19937& rng, trial& t)
+{
+	std::uniform_real_distribution<float> ux(0.f, IMAGE_WIDTH), uy(0.f, IMAGE_HEIGHT);
+	std::uniform_real_distribution<double> u(0.0, 1.0);
+	std::normal_distribution<float> noise(0.f, sc.sigma);
+	randomHomography(rng, t.H);
+
+	unsigned numInliers = (unsigned)(sc.n * sc.inlierRatio + 0.5);
+	std::vector<std::pair<double, unsigned> > order(sc.n);
+	std::vector<float> src(2 * sc.n), dst(2 * sc.n);
+	for(unsigned i = 0; i < sc.n; i++){
+		float x = ux(rng), y = uy(rng), X, Y;
+		if(i < numInliers){
+			project(t.H, x, y, X, Y);
+			X += noise(rng);
+			Y += noise(rng);
+		}else{
+			X = ux(rng);
+			Y = uy(rng);
+		}
+		src[2 * i] = x;
+		src[2 * i + 1] = y;
+		dst[2 * i] = X;
+		dst[2 * i + 1] = Y;
+		order[i] = std::make_pair(sc.ordering * (i < numInliers) + (1 - sc.ordering) * u(rng), i);
+	}
+
+	// Best score first, as the matcher hands them to PROSAC
+	std::sort(order.begin(), order.end(), std::greater<std::pair<double, unsigned> >());
+	t.src.resize(2 * sc.n);
+	t.dst.resize(2 * sc.n);
+	t.inlier.resize(sc.n);
+	for(unsigned i = 0; i < sc.n; i++){
+		unsigned j = order[i].second;
+		t.src[2 * i] = src[2 * j];
+		t.src[2 * i + 1] = src[2 * j + 1];
+		t.dst[2 * i] = dst[2 * j];
+		t.dst[2 * i + 1] = dst[2 * j + 1];
+		t.inlier[i] = j < numInliers;
+	}
+}
+
+// RMS distance between the true and estimated projections of the inliers
+double reprojError(const trial& t, const float* H)
+{
+	double sum = 0;
+	unsigned count = 0;
+	for(size_t i = 0; i < t.inlier.size(); i++){
+		if(!t.inlier[i]){
+			continue;
+		}
+		float X, Y, eX, eY;
+		project(t.H, t.src[2 * i], t.src[2 * i + 1], X, Y);
+		project(H, t.src[2 * i], t.src[2 * i + 1], eX, eY);
+		sum += (X - eX) * (X - eX) + (Y - eY) * (Y - eY);
+		count++;
+	}
+	return count ? sqrt(sum / count) : 0.0;
+}
+
+// Same threshold, caps and minimum support as frameProcessor::estimateH()
+void runRho(RHO_HEST_REFC* rho, const method& m, const trial& t, result& r,
+			std::vector<char>& mask)
+{
+	unsigned n = t.inlier.size();
+	unsigned minInliers = std::max(4U, (unsigned)(n * RANSAC_MIN_INL_RATIO));
+	float H[9];
+	mask.resize(n);
+
+	timer::time_point t0 = timer::now();
+	unsigned numInliers = rhoRefC(rho, &t.src[0], &t.dst[0], &mask[0], n,
+			(float)RANSAC_REPROJ_THRSH, (unsigned)RANSAC_MAX_ITER, (unsigned)RANSAC_MAX_ITER,
+			(double)RANSAC_CONFIDENCE, minInliers, (double)RANSAC_NR_BETA, m.flags, NULL, H);
+	timer::time_point t1 = timer::now();
+
+	RHO_HEST_STATS stats;
+	rhoRefCGetStats(rho, &stats);
+	r.ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+	r.iterations += stats.numIterations;
+	if(numInliers){
+		r.found++;
+		r.reprojSum += reprojError(t, H);
+	}
+}
+
+#ifdef BENCH_RHO_OPENCV
+void runOpenCV(const method& m, const trial& t, result& r)
+{
+	unsigned n = t.inlier.size();
+	cv::Mat src(n, 1, CV_32FC2, (void*)&t.src[0]);
+	cv::Mat dst(n, 1, CV_32FC2, (void*)&t.dst[0]);
+
+	timer::time_point t0 = timer::now();
+#if CV_MAJOR_VERSION >= 3
+	cv::Mat H = cv::findHomography(src, dst, m.cvMethod, RANSAC_REPROJ_THRSH, cv::noArray(),
+								   RANSAC_MAX_ITER, RANSAC_CONFIDENCE);
+#else
+	cv::Mat H = cv::findHomography(src, dst, m.cvMethod, RANSAC_REPROJ_THRSH);
+#endif
+	timer::time_point t1 = timer::now();
+
+	r.ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+	if(!H.empty()){
+		float h[9];
+		for(int i = 0; i < 9; i++){
+			h[i] = H.at<double>(i / 3, i % 3);
+		}
+		r.found++;
+		r.reprojSum += reprojError(t, h);
+	}
+}
+#endif
+
+void usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-trials n] [-seed s] [-n N] [-inliers r] [-sigma s] "
+			"[-ordering q]\n", name);
+	exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	int numTrials = 50;
+	unsigned seed = 1234;
+	std::vector<unsigned> sizes;
+	std::vector<double> ratios, sigmas, orderings;
+
+	for(int arg = 1; arg < argc; arg++){
+		std::string opt = argv[arg];
+		if(arg + 1 >= argc){
+			usage(argv[0]);
+		}
+		const char* value = argv[++arg];
+		if(opt == "-trials"){
+			numTrials = std::max(1, atoi(value));
+		}else if(opt == "-seed"){
+			seed = strtoul(value, NULL, 10);
+		}else if(opt == "-n"){
+			sizes.push_back(std::max(4, atoi(value)));
+		}else if(opt == "-inliers"){
+			ratios.push_back(atof(value));
+		}else if(opt == "-sigma"){
+			sigmas.push_back(atof(value));
+		}else if(opt == "-ordering"){
+			orderings.push_back(atof(value));
+		}else{
+			usage(argv[0]);
+		}
+	}
+	if(sizes.empty()){
+		unsigned defaults[] = {100, 500, 2000};
+		sizes.assign(defaults, defaults + 3);
+	}
+	if(ratios.empty()){
+		double defaults[] = {0.2, 0.5, 0.8};
+		ratios.assign(defaults, defaults + 3);
+	}
+	if(sigmas.empty()){
+		double defaults[] = {0.5, 2.0};
+		sigmas.assign(defaults, defaults + 2);
+	}
+	if(orderings.empty()){
+		double defaults[] = {0.0, 0.5, 1.0};
+		orderings.assign(defaults, defaults + 3);
+	}
+
+	/**
+	 * Every combination of the three rhoRefC flags, named after the
+	 * flags that are set
+	 */
+	std::vector<method> methods;
+	const unsigned rhoFlags[] = {RHO_FLAG_ENABLE_NR, RHO_FLAG_ENABLE_REFINEMENT,
+								 RHO_FLAG_ENABLE_FINAL_REFINEMENT};
+	const char* const rhoFlagNames[] = {"nr", "refine", "final"};
+	for(unsigned combination = 0; combination < 8; combination++){
+		method rhoMethod = {"rho", RHO_FLAG_NONE, 0};
+		for(int bit = 0; bit < 3; bit++){
+			if(combination & (1u << bit)){
+				rhoMethod.flags |= rhoFlags[bit];
+				rhoMethod.name  += std::string("+") + rhoFlagNames[bit];
+			}
+		}
+		methods.push_back(rhoMethod);
+	}
+#ifdef BENCH_RHO_OPENCV
+	method cvRansac = {"cv-ransac", ~0U, cv::RANSAC};
+	methods.push_back(cvRansac);
+#if CV_MAJOR_VERSION >= 3
+	method cvRho = {"cv-rho", ~0U, cv::RHO};
+	methods.push_back(cvRho);
+#endif
+#endif
+
+	RHO_HEST_REFC* rho = rhoRefCInit();
+	if(!rho || rhoRefCEnsureCapacity(rho, *std::max_element(sizes.begin(), sizes.end()),
+									 RANSAC_NR_BETA) != 1){
+		fprintf(stderr, "Error: could not initialize RHO\n");
+		return 1;
+	}
+
+	printf("method,n,inlier_ratio,sigma,ordering,trials,found,time_us_p50,time_us_p95,"
+		   "time_us_mean,iterations,reproj_px\n");
+
+	std::vector<trial> trials(numTrials);
+	std::vector<char> mask;
+	for(size_t a = 0; a < sizes.size(); a++)
+	for(size_t b = 0; b < ratios.size(); b++)
+	for(size_t c = 0; c < sigmas.size(); c++)
+	for(size_t d = 0; d < orderings.size(); d++){
+		scenario sc = {sizes[a], ratios[b], sigmas[c], orderings[d]};
+
+		/**
+		 * Every method sees the same trials, and RHO the same random
+		 * sequence for its samples
+		 */
+		std::mt19937 rng(seed);
+		for(int i = 0; i < numTrials; i++){
+			makeTrial(sc, rng, trials[i]);
+		}
+
+		for(size_t m = 0; m < methods.size(); m++){
+			result r;
+			srand(seed);
+			for(int i = 0; i < numTrials; i++){
+				if(methods[m].flags != ~0U){
+					runRho(rho, methods[m], trials[i], r, mask);
+				}
+#ifdef BENCH_RHO_OPENCV
+				else{
+					runOpenCV(methods[m], trials[i], r);
+				}
+#endif
+			}
+
+			double sum = 0;
+			for(size_t i = 0; i < r.ns.size(); i++){
+				sum += r.ns[i];
+			}
+			std::sort(r.ns.begin(), r.ns.end());
+			// OpenCV does not report its iterations: left empty
+			char iterations[32] = "";
+			if(methods[m].flags != ~0U){
+				snprintf(iterations, sizeof(iterations), "%.1f", (double)r.iterations / numTrials);
+			}
+			printf("%s,%u,%.2f,%.2f,%.2f,%d,%.3f,%.2f,%.2f,%.2f,%s,%.4f\n",
+				   methods[m].name.c_str(), sc.n, sc.inlierRatio, sc.sigma, sc.ordering, numTrials,
+				   (double)r.found / numTrials, sortedPercentile(r.ns, 50) * 1e-3,
+				   sortedPercentile(r.ns, 95) * 1e-3,
+				   sum / numTrials * 1e-3, iterations, r.found ? r.reprojSum / r.found : 0.0);
+			fflush(stdout);
+		}
+	}
+
+	rhoRefCFini(rho);
+	return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ *
+ * Per-frame cost of frameProcessor as a function of the number of
+ * targets in the model database.
+ *
+ * Targets are synthetic random textures whose model is built from the
+ * upright image. The query frame shows target 0 under a mild perspective
+ * on a textured background, so exactly one target should be detected
+ * whatever the size of the database. Output is CSV:
+ *
+ *     targets,features,ms_per_frame,match_ms,candidates,detections,target0_found
+ *
+ * "match_ms" is the matching stage alone (0 without TANGO_PROFILE) and
+ * "candidates" the model features compared per frame (0 without
+ * TANGO_MATCH_STATS); both are bounded by MAX_BUCKET_LENGTH.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/frame_processor.h"
+#include "synthetic_texture.h"
+
+using namespace cv;
+
+namespace {
+
+// Model of a target from its upright image only
+void addSyntheticTarget(const frameProcessor& processor, modelDatabase& model,
+						const Mat& image)
+{
+	std::vector<Feature> features;
+	std::vector<std::vector<uint32_t> > indexTbl(INDEX_TABLE_SIZE);
+
+	processor.extractFeatures(image, features);
+	for(uint32_t i = 0; i < features.size(); i++){
+		indexTbl[features[i].index].push_back(i);
+	}
+	model.addTarget(image.size(), features, indexTbl);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	int maxTargets = argc > 1 ? atoi(argv[1]) : 500;
+	int numFrames  = argc > 2 ? atoi(argv[2]) : 50;
+	const int steps[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
+
+	RNG rng(1234);
+	frameProcessor processor;
+	modelDatabase model;
+
+	/**
+	 * Query frame: target 0 warped onto a random background
+	 */
+	Size targetSize(320, 240);
+	Mat target0 = randomTexture(targetSize, rng);
+	Mat frame = randomTexture(Size(640, 480), rng);
+
+	Point2f src[4] = {Point2f(0, 0), Point2f(320, 0), Point2f(320, 240), Point2f(0, 240)};
+	Point2f dst[4] = {Point2f(170, 130), Point2f(480, 110), Point2f(470, 370), Point2f(160, 350)};
+	Mat H = getPerspectiveTransform(src, dst);
+	Mat warped, mask, rgb, output;
+	warpPerspective(target0, warped, H, frame.size());
+	warpPerspective(Mat(targetSize, CV_8UC1, Scalar::all(255)), mask, H, frame.size());
+	warped.copyTo(frame, mask);
+	cvtColor(frame, rgb, CV_GRAY2RGB);
+
+	printf("targets,features,ms_per_frame,match_ms,candidates,detections,target0_found\n");
+
+	int numTargets = 0;
+	for(size_t s = 0; s < sizeof(steps) / sizeof(steps[0]) && steps[s] <= maxTargets; s++){
+		while(numTargets < steps[s]){
+			addSyntheticTarget(processor, model,
+							   numTargets ? randomTexture(targetSize, rng) : target0);
+			numTargets++;
+		}
+		processor.setModel(std::make_shared<modelDatabase>(model));
+
+		// Warm-up: sizes the per-frame buffers for this database
+		for(int f = 0; f < 3; f++){
+			processor.processFrame(rgb, output);
+		}
+
+		uint64_t matchNs = 0;
+		processor.resetMatchStats();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for(int f = 0; f < numFrames; f++){
+			processor.processFrame(rgb, output);
+			matchNs += processor.getFrameTiming().ns[STAGE_MATCH];
+		}
+		double ms = std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count() / numFrames;
+
+		const std::vector<targetDetection>& detections = processor.getDetections();
+		bool found = false;
+		for(size_t d = 0; d < detections.size(); d++){
+			found |= detections[d].target == 0;
+		}
+
+		printf("%d,%u,%.3f,%.3f,%llu,%zu,%d\n", numTargets, model.numFeatures(),
+			   ms, matchNs * 1e-6 / numFrames,
+			   (unsigned long long)(processor.getMatchStats().candidates / numFrames),
+			   detections.size(), found ? 1 : 0);
+		fflush(stdout);
+	}
+	return 0;
+}
@@ -0,0 +1,387 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ *
+ * Offline builder for the binary target model (model.bin) consumed by
+ * frameProcessor::loadModelFromFile().
+ *
+ * The target image is rendered under many random viewpoints (scale,
+ * rotation, perspective and blur). Runtime features are extracted from
+ * every view with the same FAST/BRIEF/hash index code used on the
+ * device, and mapped back to the target image. Features that land on
+ * the same target location are clustered into one model feature whose
+ * descriptor is the bitwise majority of the cluster, and which is
+ * inserted in the bucket of every index observed often enough.
+ *
+ * Views are rendered in parallel but merged in view order, so the output
+ * only depends on the input image and the options (including the seed).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <atomic>
+#include <map>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/frame_processor.h"
+#include "tango-video-handler/model_file.h"
+
+using namespace cv;
+
+namespace {
+
+/**
+* Builder options, see usage()
+*/
+struct builderOptions {
+	std::string	input;
+	std::string	output;
+	int			numViews;		// Number of synthetic views
+	int			numThreads;		// Worker threads (0 = all cores)
+	uint64_t	seed;			// Seed of the view generator
+	float		minScale;		// Scale range of the views
+	float		maxScale;
+	float		maxRotation;	// Maximum in-plane rotation (degrees)
+	float		maxPerspective;	// Maximum corner jitter (fraction of size)
+	float		maxBlur;		// Maximum Gaussian blur sigma
+	int			cellSize;		// Clustering cell size in target pixels
+	float		minSupport;		// Fraction of views a cluster must appear in
+	float		minIndexRatio;	// Fraction of a cluster an index must reach
+	int			maxFeatures;	// Maximum number of model features
+	int			hashBits;		// Width of the hash index
+	int			mihSubstrings;	// MIH descriptor index substrings (0 = none)
+	modelFormat	format;			// Encoding of the output file
+
+	builderOptions() :
+		output("model.bin"), numViews(300), numThreads(0), seed(1234),
+		minScale(0.6f), maxScale(1.4f), maxRotation(25.f),
+		maxPerspective(0.15f), maxBlur(1.5f), cellSize(3),
+		minSupport(0.05f), minIndexRatio(0.1f), maxFeatures(3000),
+		hashBits(DEFAULT_HASH_BITS), mihSubstrings(0), format(MODEL_RAW) {}
+};
+
+/**
+* A runtime feature observed in one view, in target coordinates
+*/
+struct observation {
+	uint32_t	cell;			// Clustering cell
+	float		x, y;			// Location in the target image
+	Feature		feature;
+};
+
+/**
+* A cluster of observations of the same target location
+*/
+struct cluster {
+	float		sumX, sumY;
+	uint32_t	count;
+	uint16_t	bitCount[DESCRIPTOR_LENGTH];
+	std::map<uint32_t, uint32_t> indices;	// index -> number of observations
+
+	cluster() : sumX(0), sumY(0), count(0) {
+		memset(bitCount, 0, sizeof(bitCount));
+	}
+};
+
+void usage(const char* name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] <target image>\n"
+		"  -o <file>        output model (default model.bin)\n"
+		"  -n <views>       number of synthetic views (default 300)\n"
+		"  -j <threads>     worker threads, 0 for all cores (default 0)\n"
+		"  -s <seed>        seed of the view generator (default 1234)\n"
+		"  -scale <lo> <hi> scale range of the views (default 0.6 1.4)\n"
+		"  -rot <deg>       maximum in-plane rotation (default 25)\n"
+		"  -persp <ratio>   maximum corner jitter (default 0.15)\n"
+		"  -blur <sigma>    maximum Gaussian blur (default 1.5)\n"
+		"  -cell <px>       clustering cell size (default 3)\n"
+		"  -support <ratio> minimum fraction of views (default 0.05)\n"
+		"  -max <features>  maximum number of model features (default 3000)\n"
+		"  -bits <n>        hash index width, 10 to 18 (default 13, others need -z)\n"
+		"  -mih <m>         match through an MIH index of m = 16 or 32 descriptor\n"
+		"                   substrings instead of the hash index (needs -z)\n"
+		"  -z               write the compressed model format\n",
+		name);
+}
+
+int parseOptions(int argc, char** argv, builderOptions& opt)
+{
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if(arg == "-o" && hasValue){
+			opt.output = argv[++i];
+		}else if(arg == "-n" && hasValue){
+			opt.numViews = atoi(argv[++i]);
+		}else if(arg == "-j" && hasValue){
+			opt.numThreads = atoi(argv[++i]);
+		}else if(arg == "-s" && hasValue){
+			opt.seed = strtoull(argv[++i], NULL, 10);
+		}else if(arg == "-scale" && i + 2 < argc){
+			opt.minScale = atof(argv[++i]);
+			opt.maxScale = atof(argv[++i]);
+		}else if(arg == "-rot" && hasValue){
+			opt.maxRotation = atof(argv[++i]);
+		}else if(arg == "-persp" && hasValue){
+			opt.maxPerspective = atof(argv[++i]);
+		}else if(arg == "-blur" && hasValue){
+			opt.maxBlur = atof(argv[++i]);
+		}else if(arg == "-cell" && hasValue){
+			opt.cellSize = std::max(1, atoi(argv[++i]));
+		}else if(arg == "-support" && hasValue){
+			opt.minSupport = atof(argv[++i]);
+		}else if(arg == "-max" && hasValue){
+			opt.maxFeatures = atoi(argv[++i]);
+		}else if(arg == "-bits" && hasValue){
+			opt.hashBits = atoi(argv[++i]);
+		}else if(arg == "-mih" && hasValue){
+			opt.mihSubstrings = atoi(argv[++i]);
+		}else if(arg == "-z"){
+			opt.format = MODEL_COMPRESSED;
+		}else if(arg[0] != '-' && opt.input.empty()){
+			opt.input = arg;
+		}else{
+			return RET_FAILED;
+		}
+	}
+	if(opt.hashBits < MIN_HASH_BITS || opt.hashBits > MAX_HASH_BITS ||
+	   (opt.hashBits != DEFAULT_HASH_BITS && opt.format == MODEL_RAW) ||
+	   (opt.mihSubstrings && opt.mihSubstrings != 16 && opt.mihSubstrings != 32) ||
+	   (opt.mihSubstrings && opt.format == MODEL_RAW)){
+		return RET_FAILED;
+	}
+	return opt.input.empty() || opt.numViews <= 0 ? RET_FAILED : RET_SUCCESS;
+}
+
+/**
+* Random homography mapping the target image to a synthetic view,
+* with the view translated so that the whole target is visible.
+*/
+Mat randomView(const Size& size, RNG& rng, const builderOptions& opt, Size& viewSize)
+{
+	float scale = rng.uniform(opt.minScale, opt.maxScale);
+	float angle = rng.uniform(-opt.maxRotation, opt.maxRotation) * (float)CV_PI / 180.f;
+	float c = cos(angle), s = sin(angle);
+	float cx = size.width * 0.5f, cy = size.height * 0.5f;
+
+	Point2f src[4] = {Point2f(0, 0), Point2f(size.width, 0),
+					  Point2f(size.width, size.height), Point2f(0, size.height)};
+	Point2f dst[4];
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+
+	for(int i = 0; i < 4; i++){
+		// Perspective: jitter every corner independently
+		float jx = rng.uniform(-opt.maxPerspective, opt.maxPerspective) * size.width;
+		float jy = rng.uniform(-opt.maxPerspective, opt.maxPerspective) * size.height;
+		float x = src[i].x - cx + jx;
+		float y = src[i].y - cy + jy;
+
+		dst[i] = Point2f(scale * (c * x - s * y), scale * (s * x + c * y));
+		minX = std::min(minX, dst[i].x);
+		minY = std::min(minY, dst[i].y);
+		maxX = std::max(maxX, dst[i].x);
+		maxY = std::max(maxY, dst[i].y);
+	}
+
+	// Keep a margin so that border features survive the BRIEF boundary check
+	float margin = 2 * HALF_PATCH_WIDTH;
+	for(int i = 0; i < 4; i++){
+		dst[i].x += margin - minX;
+		dst[i].y += margin - minY;
+	}
+	viewSize = Size((int)(maxX - minX + 2 * margin), (int)(maxY - minY + 2 * margin));
+
+	return getPerspectiveTransform(src, dst);
+}
+
+/**
+* Render view "v" and collect its features in target coordinates
+*/
+void processView(int v, const Mat& target, const frameProcessor& processor,
+				 const builderOptions& opt, std::vector<observation>& out)
+{
+	RNG rng(opt.seed * 6364136223846793005ULL + (uint64_t)v * 1442695040888963407ULL + 1);
+
+	Size viewSize;
+	Mat H = randomView(target.size(), rng, opt, viewSize);
+	Mat view;
+	warpPerspective(target, view, H, viewSize, INTER_LINEAR, BORDER_CONSTANT,
+					Scalar::all(rng.uniform(0, 256)));
+
+	float sigma = rng.uniform(0.f, opt.maxBlur);
+	if(sigma > 0.3f){
+		GaussianBlur(view, view, Size(0, 0), sigma);
+	}
+
+	std::vector<Feature> features;
+	processor.extractFeatures(view, features, opt.hashBits);
+
+	/**
+	 * Back-project the features into the target image
+	 */
+	Mat Hinv;
+	H.convertTo(Hinv, CV_64F);
+	Hinv = Hinv.inv();
+	const double* h = Hinv.ptr<double>(0);
+	int cellsPerRow = (target.cols + opt.cellSize - 1) / opt.cellSize;
+
+	out.reserve(features.size());
+	for(size_t i = 0; i < features.size(); i++){
+		double x = features[i].x, y = features[i].y;
+		double w = h[6] * x + h[7] * y + h[8];
+		float tx = (float)((h[0] * x + h[1] * y + h[2]) / w);
+		float ty = (float)((h[3] * x + h[4] * y + h[5]) / w);
+
+		if(tx < 0 || ty < 0 || tx >= target.cols || ty >= target.rows){
+			continue;
+		}
+
+		observation obs;
+		obs.cell	= (uint32_t)(ty / opt.cellSize) * cellsPerRow + (uint32_t)(tx / opt.cellSize);
+		obs.x		= tx;
+		obs.y		= ty;
+		obs.feature = features[i];
+		out.push_back(obs);
+	}
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	builderOptions opt;
+	if(parseOptions(argc, argv, opt) != RET_SUCCESS){
+		usage(argv[0]);
+		return 1;
+	}
+
+	Mat target = imread(opt.input, CV_LOAD_IMAGE_GRAYSCALE);
+	if(target.empty()){
+		fprintf(stderr, "Error: could not read %s\n", opt.input.c_str());
+		return 1;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	/**
+	 * Render and describe the views in parallel. Each view owns its
+	 * output slot, so the merge below does not depend on scheduling.
+	 */
+	int numThreads = opt.numThreads > 0 ? opt.numThreads :
+					 std::max(1, (int)std::thread::hardware_concurrency());
+	std::vector<std::vector<observation> > views(opt.numViews);
+	std::atomic<int> nextView(0);
+	frameProcessor processor;
+
+	setNumThreads(1);	// one OpenCV thread per worker
+	std::vector<std::thread> workers;
+	for(int t = 0; t < numThreads; t++){
+		workers.push_back(std::thread([&]() {
+			int v;
+			while((v = nextView++) < opt.numViews){
+				processView(v, target, processor, opt, views[v]);
+			}
+		}));
+	}
+	for(size_t t = 0; t < workers.size(); t++){
+		workers[t].join();
+	}
+
+	/**
+	 * Cluster the observations by target cell, in view order
+	 */
+	std::map<uint32_t, cluster> clusters;
+	size_t numObservations = 0;
+	for(int v = 0; v < opt.numViews; v++){
+		numObservations += views[v].size();
+		for(size_t i = 0; i < views[v].size(); i++){
+			const observation& obs = views[v][i];
+			cluster& c = clusters[obs.cell];
+
+			c.sumX += obs.x;
+			c.sumY += obs.y;
+			c.count++;
+			c.indices[obs.feature.index]++;
+			for(int b = 0; b < DESCRIPTOR_LENGTH; b++){
+				c.bitCount[b] += (obs.feature.descriptor[b / 32] >> (b & 31)) & 1;
+			}
+		}
+		std::vector<observation>().swap(views[v]);
+	}
+
+	/**
+	 * Keep the most repeatable clusters
+	 */
+	uint32_t minCount = std::max(2U, (uint32_t)(opt.minSupport * opt.numViews));
+	std::vector<std::pair<uint32_t, uint32_t> > ranked;	// (count, cell)
+	std::map<uint32_t, cluster>::const_iterator it;
+	for(it = clusters.begin(); it != clusters.end(); ++it){
+		if(it->second.count >= minCount){
+			ranked.push_back(std::make_pair(it->second.count, it->first));
+		}
+	}
+	std::stable_sort(ranked.begin(), ranked.end(),
+					 [](const std::pair<uint32_t, uint32_t>& a,
+						const std::pair<uint32_t, uint32_t>& b) {
+						 return a.first > b.first;
+					 });
+	if((int)ranked.size() > opt.maxFeatures){
+		ranked.resize(opt.maxFeatures);
+	}
+
+	/**
+	 * One model feature per cluster: mean location, majority descriptor,
+	 * inserted in every bucket seen in at least minIndexRatio of the cluster
+	 */
+	std::vector<Feature> features(ranked.size());
+	std::vector<std::vector<uint32_t> > indexTbl((size_t)1 << opt.hashBits);
+	size_t numEntries = 0;
+
+	for(size_t f = 0; f < ranked.size(); f++){
+		const cluster& c = clusters[ranked[f].second];
+		Feature& feature = features[f];
+
+		feature.x = (unsigned short)(c.sumX / c.count + 0.5f);
+		feature.y = (unsigned short)(c.sumY / c.count + 0.5f);
+		for(int b = 0; b < DESCRIPTOR_LENGTH; b++){
+			if(2 * c.bitCount[b] > c.count){
+				feature.descriptor[b / 32] |= 1U << (b & 31);
+			}
+		}
+
+		uint32_t best = 0;
+		std::map<uint32_t, uint32_t>::const_iterator idx;
+		for(idx = c.indices.begin(); idx != c.indices.end(); ++idx){
+			if(idx->second > best){
+				best = idx->second;
+				feature.index = idx->first;
+			}
+			if(idx->second >= opt.minIndexRatio * c.count){
+				indexTbl[idx->first].push_back(f);
+				numEntries++;
+			}
+		}
+	}
+
+	if(writeModelFile(opt.output, target.size(), features, indexTbl,
+					  opt.format, opt.mihSubstrings) != RET_SUCCESS){
+		fprintf(stderr, "Error: could not write %s\n", opt.output.c_str());
+		return 1;
+	}
+
+	double elapsed = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+	printf("%s: %d views, %zu observations, %zu clusters, %zu features, "
+		   "%zu index entries, %.2f s on %d threads\n",
+		   opt.output.c_str(), opt.numViews, numObservations, clusters.size(),
+		   features.size(), numEntries, elapsed, numThreads);
+	return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ *
+ * Converts a model file between the raw and compressed encodings and
+ * reports, for both, the file size and the time readModelFile() takes
+ * from a cold page cache (pages of the file are dropped before every
+ * run) and from a warm one.
+ *
+ *     model_compress [-d] <input model> <output model>
+ *
+ * The input may be of either format; -d writes the raw format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/model_file.h"
+
+using namespace cv;
+
+namespace {
+
+const int NUM_RUNS = 5;
+
+long fileSize(const std::string& filename)
+{
+	FILE* dFile = fopen(filename.c_str(), "rb");
+	if(!dFile){
+		return -1;
+	}
+	fseek(dFile, 0, SEEK_END);
+	long size = ftell(dFile);
+	fclose(dFile);
+	return size;
+}
+
+// Evict the pages of the file from the page cache
+void dropCache(const std::string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if(fd >= 0){
+		fdatasync(fd);
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+// Best time over NUM_RUNS loads, in milliseconds
+double loadTime(const std::string& filename, bool cold)
+{
+	double best = 1e30;
+	for(int r = 0; r < NUM_RUNS; r++){
+		Size size;
+		std::vector<Feature> features;
+		std::vector<std::vector<uint32_t> > indexTbl;
+
+		if(cold){
+			dropCache(filename);
+		}
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		if(readModelFile(filename, size, features, indexTbl) != RET_SUCCESS){
+			return -1;
+		}
+		best = std::min(best, std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count());
+	}
+	return best;
+}
+
+void report(const char* label, const std::string& filename)
+{
+	printf("%-10s %-32s %10ld bytes  cold %8.3f ms  warm %8.3f ms\n", label,
+		   filename.c_str(), fileSize(filename), loadTime(filename, true),
+		   loadTime(filename, false));
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	modelFormat format = MODEL_COMPRESSED;
+	int arg = 1;
+	if(arg < argc && std::string(argv[arg]) == "-d"){
+		format = MODEL_RAW;
+		arg++;
+	}
+	if(argc - arg != 2){
+		fprintf(stderr, "Usage: %s [-d] <input model> <output model>\n", argv[0]);
+		return 1;
+	}
+	std::string input = argv[arg], output = argv[arg + 1];
+
+	Size size;
+	std::vector<Feature> features;
+	std::vector<std::vector<uint32_t> > indexTbl;
+	int mihSubstrings = 0;
+
+	if(readModelFile(input, size, features, indexTbl, &mihSubstrings) != RET_SUCCESS){
+		fprintf(stderr, "Error: could not read %s\n", input.c_str());
+		return 1;
+	}
+	if(writeModelFile(output, size, features, indexTbl, format,
+					  format == MODEL_COMPRESSED ? mihSubstrings : 0) != RET_SUCCESS){
+		fprintf(stderr, "Error: could not write %s\n", output.c_str());
+		return 1;
+	}
+
+	size_t numEntries = 0;
+	for(size_t i = 0; i < indexTbl.size(); i++){
+		numEntries += indexTbl[i].size();
+	}
+	printf("%dx%d target, %zu features, %zu index entries\n",
+		   size.width, size.height, features.size(), numEntries);
+	report("input", input);
+	report("output", output);
+	return 0;
+}
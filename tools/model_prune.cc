@@ -0,0 +1,209 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ *
+ * Post-processing of a model file: removes non-distinctive features and
+ * caps the length of the buckets of the index.
+ *
+ * A feature is non-distinctive when more than "-k" other model features
+ * lie within MIN_HAMMING_DIST of it: a query matching it is as likely to
+ * match its neighbours, and every one of them lengthens the buckets it
+ * is in. With "-cap", the entries of a bucket longer than the cap are
+ * ranked by distinctiveness and only the best ones are kept. Features
+ * left in no bucket are dropped from the feature table.
+ *
+ * The matching cost of a query is the length of its bucket, so the tool
+ * reports the expected number of candidates per query before and after:
+ * "uniform" assumes queries spread evenly over the buckets, "weighted"
+ * assumes they follow the hash indices of the model features.
+ *
+ *     model_prune [-k neighbours] [-cap length] [-z] <input model> <output model>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/frame_processor.h"
+#include "tango-video-handler/model_file.h"
+
+using namespace cv;
+
+namespace {
+
+struct pruneOptions {
+	std::string	input;
+	std::string	output;
+	int			maxNeighbours;	// Features with more neighbours are removed
+	int			maxBucket;		// Maximum bucket length (0 = no cap)
+	modelFormat	format;
+
+	pruneOptions() : maxNeighbours(8), maxBucket(0), format(MODEL_RAW) {}
+};
+
+void usage(const char* name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] <input model> <output model>\n"
+		"  -k <count>       maximum neighbours within MIN_HAMMING_DIST (default 8)\n"
+		"  -cap <length>    maximum bucket length, 0 for none (default 0)\n"
+		"  -z               write the compressed model format\n",
+		name);
+}
+
+int parseOptions(int argc, char** argv, pruneOptions& opt)
+{
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if(arg == "-k" && hasValue){
+			opt.maxNeighbours = atoi(argv[++i]);
+		}else if(arg == "-cap" && hasValue){
+			opt.maxBucket = std::max(0, atoi(argv[++i]));
+		}else if(arg == "-z"){
+			opt.format = MODEL_COMPRESSED;
+		}else if(arg[0] != '-' && opt.input.empty()){
+			opt.input = arg;
+		}else if(arg[0] != '-' && opt.output.empty()){
+			opt.output = arg;
+		}else{
+			return RET_FAILED;
+		}
+	}
+	return opt.input.empty() || opt.output.empty() ? RET_FAILED : RET_SUCCESS;
+}
+
+/**
+* Print bucket occupancy and expected candidates per query.
+* "queryWeight" is the fraction of queries expected in every bucket.
+*/
+void report(const char* label, const std::vector<Feature>& features,
+			const std::vector<std::vector<uint32_t> >& indexTbl,
+			const std::vector<double>& queryWeight)
+{
+	std::vector<uint32_t> lengths(indexTbl.size());
+	size_t numEntries = 0;
+	double weighted = 0;
+	for(size_t i = 0; i < indexTbl.size(); i++){
+		lengths[i]  = indexTbl[i].size();
+		numEntries += lengths[i];
+		weighted   += queryWeight[i] * lengths[i];
+	}
+	std::sort(lengths.begin(), lengths.end());
+	size_t empty = std::lower_bound(lengths.begin(), lengths.end(), 1u) - lengths.begin();
+
+	printf("%-7s %6zu features %7zu entries | buckets: %zu empty, median %u, "
+		   "p99 %u, max %u | candidates/query: uniform %.2f, weighted %.2f\n",
+		   label, features.size(), numEntries, empty, lengths[lengths.size() / 2],
+		   lengths[lengths.size() * 99 / 100], lengths.back(),
+		   (double)numEntries / indexTbl.size(), weighted);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	pruneOptions opt;
+	if(parseOptions(argc, argv, opt) != RET_SUCCESS){
+		usage(argv[0]);
+		return 1;
+	}
+
+	Size size;
+	std::vector<Feature> features;
+	std::vector<std::vector<uint32_t> > indexTbl;
+	int mihSubstrings = 0;
+	if(readModelFile(opt.input, size, features, indexTbl, &mihSubstrings) != RET_SUCCESS){
+		fprintf(stderr, "Error: could not read %s\n", opt.input.c_str());
+		return 1;
+	}
+	uint32_t n = features.size();
+
+	/**
+	 * Queries are assumed to hash like the model features themselves
+	 */
+	std::vector<double> queryWeight(indexTbl.size(), 0);
+	for(uint32_t i = 0; i < n; i++){
+		if(features[i].index < queryWeight.size()){
+			queryWeight[features[i].index] += 1.0 / n;
+		}
+	}
+	report("before", features, indexTbl, queryWeight);
+
+	/**
+	 * Neighbours of every feature within MIN_HAMMING_DIST
+	 */
+	std::vector<uint32_t> neighbours(n, 0);
+	uint64_t words = 0;
+	for(uint32_t i = 0; i < n; i++){
+		for(uint32_t j = i + 1; j < n; j++){
+			if(descriptorDistance(features[i].descriptor, features[j].descriptor,
+								  MIN_HAMMING_DIST, words) < MIN_HAMMING_DIST){
+				neighbours[i]++;
+				neighbours[j]++;
+			}
+		}
+	}
+
+	/**
+	 * Drop non-distinctive entries, then cap every bucket keeping the
+	 * most distinctive features (fewest neighbours, then lowest index).
+	 */
+	std::vector<std::vector<uint32_t> > prunedTbl(indexTbl.size());
+	std::vector<bool> used(n, false);
+	uint32_t numNonDistinctive = 0;
+	for(uint32_t i = 0; i < n; i++){
+		numNonDistinctive += neighbours[i] > (uint32_t)opt.maxNeighbours;
+	}
+
+	for(size_t b = 0; b < indexTbl.size(); b++){
+		std::vector<std::pair<uint32_t, uint32_t> > ranked;
+		for(size_t j = 0; j < indexTbl[b].size(); j++){
+			uint32_t f = indexTbl[b][j];
+			if(f < n && neighbours[f] <= (uint32_t)opt.maxNeighbours){
+				ranked.push_back(std::make_pair(neighbours[f], f));
+			}
+		}
+		if(opt.maxBucket && ranked.size() > (size_t)opt.maxBucket){
+			std::sort(ranked.begin(), ranked.end());
+			ranked.resize(opt.maxBucket);
+		}
+		for(size_t j = 0; j < ranked.size(); j++){
+			prunedTbl[b].push_back(ranked[j].second);
+			used[ranked[j].second] = true;
+		}
+		std::sort(prunedTbl[b].begin(), prunedTbl[b].end());
+	}
+
+	/**
+	 * Compact the feature table and re-number the bucket entries
+	 */
+	std::vector<Feature> pruned;
+	std::vector<uint32_t> remap(n);
+	for(uint32_t i = 0; i < n; i++){
+		if(used[i]){
+			remap[i] = pruned.size();
+			pruned.push_back(features[i]);
+		}
+	}
+	for(size_t b = 0; b < prunedTbl.size(); b++){
+		for(size_t j = 0; j < prunedTbl[b].size(); j++){
+			prunedTbl[b][j] = remap[prunedTbl[b][j]];
+		}
+	}
+
+	if(writeModelFile(opt.output, size, pruned, prunedTbl, opt.format,
+					  opt.format == MODEL_COMPRESSED ? mihSubstrings : 0) != RET_SUCCESS){
+		fprintf(stderr, "Error: could not write %s\n", opt.output.c_str());
+		return 1;
+	}
+
+	report("after", pruned, prunedTbl, queryWeight);
+	printf("%u non-distinctive features (more than %d neighbours within %d bits), "
+		   "%zu features removed\n",
+		   numNonDistinctive, opt.maxNeighbours, MIN_HAMMING_DIST, n - pruned.size());
+	return 0;
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#ifndef TOOLS_PERCENTILE_H_
+#define TOOLS_PERCENTILE_H_
+
+#include <stddef.h>
+#include <vector>
+#include <algorithm>
+
+/**
+* Value at percentile "p" (0 to 100) of samples sorted in ascending
+* order, by nearest rank; 0 if there is none
+*/
+template<typename T>
+double sortedPercentile(const std::vector<T>& sorted, double p)
+{
+	if(sorted.empty()){
+		return 0.0;
+	}
+	size_t rank = std::max((size_t)1, (size_t)(p / 100.0 * sorted.size() + 0.5));
+	return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+// Same as sortedPercentile, on unsorted samples
+template<typename T>
+double percentile(std::vector<T> values, double p)
+{
+	std::sort(values.begin(), values.end());
+	return sortedPercentile(values, p);
+}
+
+#endif  // TOOLS_PERCENTILE_H_
@@ -0,0 +1,456 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ *
+ * Accuracy and latency regression harness for frameProcessor.
+ *
+ * Runs a sequence with ground-truth homographies through processFrame
+ * and scores every frame: whether the target was found, the distance
+ * between the target corners projected by the estimated and the true
+ * homographies, and the time spent. The summary is compared against a
+ * stored baseline and a single PASS/FAIL report is printed (exit code 0
+ * or 1), so that speed-ups can be checked for lost detection quality.
+ *
+ * The sequence is either synthetic, a random texture (or -target image)
+ * moving, rotating, scaling and tilting over a random background with
+ * sensor noise, one frame in ten without the target, or a recording
+ * (see replay) with its model and a ground-truth file:
+ *
+ *     regress [options]                                   synthetic
+ *     regress [options] -model model.bin -truth truth.txt <recording>
+ *
+ * The ground-truth file has one line per frame: "-" if no target is in
+ * view, otherwise the target id and the 9 entries of the homography
+ * from the target to the frame, row by row.
+ *
+ * Options:
+ *     -baseline file  compare against the baseline (default: report only)
+ *     -save file      write the summary of this run as a baseline
+ *     -frames n       synthetic sequence length (default 200)
+ *     -target image   synthetic target image (default random texture)
+ *     -latency-tol t  allowed relative latency increase (default 0.15);
+ *                     negative to ignore latency (other machine)
+ *     -csv file       per-frame scores
+ *     -size WxH, -probes n, -bucket   as for replay
+ *
+ * Baselines are not portable: latency depends on the machine and
+ * detection on the OpenCV build. Save one with -save on the machine
+ * that runs the check, from the build before the change. The committed
+ * tools/regress_baseline.txt (synthetic, default options) is checked
+ * with -latency-tol -1 only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/frame_processor.h"
+#include "tango-video-handler/frame_recording.h"
+#include "percentile.h"
+#include "synthetic_texture.h"
+
+using namespace cv;
+
+namespace {
+
+typedef std::chrono::steady_clock timer;
+
+const float MAX_CORNER_ERR = 10.f;		// Corner error of a correct detection, in pixels
+const int	NEGATIVE_PERIOD = 10;		// Synthetic frames without the target
+
+struct frameTruth {
+	int		target;			// -1 if no target in view
+	double	H[9];			// From the target to the frame
+};
+
+struct frameScore {
+	int		 target;		// Ground truth, -1 if none
+	bool	 found;			// The target was detected
+	bool	 correct;		// ... within MAX_CORNER_ERR
+	bool	 falseAlarm;	// Another target, or a detection where there is none
+	float	 cornerErr;		// Largest corner error of the detection (if found)
+	uint64_t ns;			// processFrame time
+};
+
+/**
+* Summary of a run, as stored in baselines
+*/
+struct summary {
+	std::map<std::string, double> values;
+
+	int load(const std::string& filename) {
+		FILE* dFile = fopen(filename.c_str(), "r");
+		if(!dFile){
+			return RET_FAILED;
+		}
+		char key[64];
+		double value;
+		char line[256];
+		while(fgets(line, sizeof(line), dFile)){
+			if(line[0] != '#' && sscanf(line, "%63s %lf", key, &value) == 2){
+				values[key] = value;
+			}
+		}
+		fclose(dFile);
+		return RET_SUCCESS;
+	}
+
+	int save(const std::string& filename, const std::string& comment) const {
+		FILE* dFile = fopen(filename.c_str(), "w");
+		if(!dFile){
+			return RET_FAILED;
+		}
+		fprintf(dFile, "# regress baseline: %s\n", comment.c_str());
+		for(std::map<std::string, double>::const_iterator it = values.begin();
+			it != values.end(); ++it){
+			fprintf(dFile, "%s %.6f\n", it->first.c_str(), it->second);
+		}
+		return fclose(dFile) == 0 ? RET_SUCCESS : RET_FAILED;
+	}
+};
+
+// Smooth camera path: target centered at "t" of the sequence (0 to 1)
+Mat pathHomography(const Size& target, const Size& frame, double t)
+{
+	double a = 0.4 * sin(2 * CV_PI * 1.5 * t);
+	double s = 1.0 + 0.25 * sin(2 * CV_PI * t);
+	double p = 4e-4 * sin(2 * CV_PI * 2 * t), q = 3e-4 * cos(2 * CV_PI * 2 * t);
+	double cx = frame.width / 2 + 0.15 * frame.width * cos(2 * CV_PI * t);
+	double cy = frame.height / 2 + 0.15 * frame.height * sin(2 * CV_PI * t);
+
+	Mat center = (Mat_<double>(3, 3) << 1, 0, -target.width / 2.0,
+										0, 1, -target.height / 2.0, 0, 0, 1);
+	Mat tilt   = (Mat_<double>(3, 3) << 1, 0, 0, 0, 1, 0, p, q, 1);
+	Mat rotate = (Mat_<double>(3, 3) << s * cos(a), -s * sin(a), cx,
+										s * sin(a), s * cos(a), cy, 0, 0, 1);
+	Mat H = rotate * tilt * center;
+	return H / H.at<double>(2, 2);
+}
+
+// Synthetic frame and its ground truth
+void syntheticFrame(const Mat& target, const Size& size, int f, int numFrames,
+					RNG& rng, Mat& rgb, frameTruth& truth)
+{
+	Mat frame = randomTexture(size, rng);
+	truth.target = f % NEGATIVE_PERIOD == NEGATIVE_PERIOD - 1 ? -1 : 0;
+	if(truth.target >= 0){
+		Mat H = pathHomography(target.size(), size, (double)f / numFrames);
+		Mat warped, mask;
+		warpPerspective(target, warped, H, size);
+		warpPerspective(Mat(target.size(), CV_8UC1, Scalar::all(255)), mask, H, size);
+		warped.copyTo(frame, mask);
+		for(int i = 0; i < 9; i++){
+			truth.H[i] = H.at<double>(i / 3, i % 3);
+		}
+	}
+
+	// Sensor noise
+	Mat noise(size, CV_16SC1);
+	randn(noise, Scalar::all(0), Scalar::all(4));
+	frame.convertTo(frame, CV_16SC1);
+	frame += noise;
+	frame.convertTo(frame, CV_8UC1);
+	cvtColor(frame, rgb, CV_GRAY2RGB);
+}
+
+int loadTruth(const std::string& filename, std::vector<frameTruth>& truths)
+{
+	FILE* dFile = fopen(filename.c_str(), "r");
+	if(!dFile){
+		return RET_FAILED;
+	}
+	char line[512];
+	while(fgets(line, sizeof(line), dFile)){
+		frameTruth truth;
+		truth.target = -1;
+		double* H = truth.H;
+		if(line[0] != '-' &&
+		   sscanf(line, "%d %lf %lf %lf %lf %lf %lf %lf %lf %lf", &truth.target,
+				  &H[0], &H[1], &H[2], &H[3], &H[4], &H[5], &H[6], &H[7], &H[8]) != 10){
+			fclose(dFile);
+			return RET_FAILED;
+		}
+		truths.push_back(truth);
+	}
+	fclose(dFile);
+	return RET_SUCCESS;
+}
+
+Point2f project(const double* H, const Point2f& p)
+{
+	double z = H[6] * p.x + H[7] * p.y + H[8];
+	return Point2f((H[0] * p.x + H[1] * p.y + H[2]) / z, (H[3] * p.x + H[4] * p.y + H[5]) / z);
+}
+
+// Score the detections of a frame against its ground truth
+frameScore scoreFrame(const modelDatabase& model, const std::vector<targetDetection>& detections,
+					  const frameTruth& truth, uint64_t ns)
+{
+	frameScore score = {truth.target, false, false, false, 0.f, ns};
+	for(size_t d = 0; d < detections.size(); d++){
+		const targetDetection& detection = detections[d];
+		if((int)detection.target != truth.target){
+			score.falseAlarm = true;
+			continue;
+		}
+		double H[9];
+		for(int i = 0; i < 9; i++){
+			H[i] = detection.H[i];
+		}
+		float err = 0.f;
+		const modelTarget& target = model.target(detection.target);
+		for(int i = 0; i < 4; i++){
+			Point2f e = project(H, target.corners[i]) - project(truth.H, target.corners[i]);
+			err = std::max(err, (float)sqrt(e.x * e.x + e.y * e.y));
+		}
+		score.found		= true;
+		score.cornerErr	= err;
+		score.correct	= err <= MAX_CORNER_ERR;
+		score.falseAlarm |= !score.correct;
+	}
+	return score;
+}
+
+summary summarize(const std::vector<frameScore>& scores)
+{
+	uint32_t numVisible = 0, numCorrect = 0, numFalse = 0;
+	std::vector<float> errors;
+	std::vector<uint64_t> ns;
+	for(size_t f = 0; f < scores.size(); f++){
+		numVisible += scores[f].target >= 0;
+		numCorrect += scores[f].correct;
+		numFalse   += scores[f].falseAlarm;
+		if(scores[f].correct){
+			errors.push_back(scores[f].cornerErr);
+		}
+		ns.push_back(scores[f].ns);
+	}
+
+	summary s;
+	s.values["frames"]				= scores.size();
+	s.values["detection_rate"]		= numVisible ? (double)numCorrect / numVisible : 1.0;
+	s.values["false_alarm_rate"]	= scores.empty() ? 0.0 : (double)numFalse / scores.size();
+	s.values["corner_err_p50_px"]	= percentile(errors, 50);
+	s.values["corner_err_p95_px"]	= percentile(errors, 95);
+	s.values["latency_p50_ms"]		= percentile(ns, 50) * 1e-6;
+	s.values["latency_p95_ms"]		= percentile(ns, 95) * 1e-6;
+	return s;
+}
+
+/**
+* One line of the report. A metric passes if "current" is on the right
+* side of "limit".
+*/
+bool check(const char* name, double base, double current, double limit, bool higherIsBetter)
+{
+	bool pass = higherIsBetter ? current >= limit : current <= limit;
+	printf("%-20s %10.3f %10.3f %10.3f   %s\n", name, base, current, limit,
+		   pass ? "ok" : "FAIL");
+	return pass;
+}
+
+void usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-baseline file] [-save file] [-frames n] [-target image] "
+			"[-latency-tol t] [-csv file] [-size WxH] [-probes n] [-bucket] "
+			"[-model model.bin -truth truth.txt <recording>]\n", name);
+	exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	std::string baselineFile, saveFile, targetFile, modelFile, truthFile, csvFile;
+	int numFrames = 200, probeBudget = 0;
+	double latencyTol = 0.15;
+	uint32_t width = 0, height = 0;
+	matchMode mode = MATCH_BY_FEATURE;
+
+	int arg = 1;
+	for(; arg < argc && argv[arg][0] == '-'; arg++){
+		std::string opt = argv[arg];
+		if(opt == "-bucket"){
+			mode = MATCH_BY_BUCKET;
+			continue;
+		}
+		if(arg + 1 >= argc){
+			usage(argv[0]);
+		}
+		const char* value = argv[++arg];
+		if(opt == "-baseline"){
+			baselineFile = value;
+		}else if(opt == "-save"){
+			saveFile = value;
+		}else if(opt == "-frames"){
+			numFrames = std::max(1, atoi(value));
+		}else if(opt == "-target"){
+			targetFile = value;
+		}else if(opt == "-latency-tol"){
+			latencyTol = atof(value);
+		}else if(opt == "-csv"){
+			csvFile = value;
+		}else if(opt == "-size"){
+			if(sscanf(value, "%ux%u", &width, &height) != 2){
+				usage(argv[0]);
+			}
+		}else if(opt == "-probes"){
+			probeBudget = atoi(value);
+		}else if(opt == "-model"){
+			modelFile = value;
+		}else if(opt == "-truth"){
+			truthFile = value;
+		}else{
+			usage(argv[0]);
+		}
+	}
+	bool recorded = !modelFile.empty();
+	if(argc - arg != (recorded ? 1 : 0) || recorded == truthFile.empty()){
+		usage(argv[0]);
+	}
+
+	frameProcessor processor;
+	processor.setMatchMode(mode);
+	processor.setProbeBudget(probeBudget);
+
+	/**
+	 * Sequence: recording and ground truth, or synthetic target
+	 */
+	frameRecording recording;
+	std::vector<frameTruth> truths;
+	Mat target;
+	RNG rng(1234);
+	Size frameSize(640, 480);
+	std::string description;
+
+	if(recorded){
+		if(processor.loadModelFromFile(modelFile) != RET_SUCCESS ||
+		   recording.open(argv[arg], width, height) != RET_SUCCESS ||
+		   loadTruth(truthFile, truths) != RET_SUCCESS){
+			fprintf(stderr, "Error: could not load %s, %s or %s\n", modelFile.c_str(),
+					argv[arg], truthFile.c_str());
+			return 2;
+		}
+		if(truths.size() != recording.numFrames()){
+			fprintf(stderr, "Error: %zu ground-truth lines for %u frames\n", truths.size(),
+					recording.numFrames());
+			return 2;
+		}
+		numFrames	= recording.numFrames();
+		frameSize	= Size(recording.width(), recording.height());
+		description	= std::string(argv[arg]) + ", " + modelFile;
+	}else{
+		target = targetFile.empty() ? randomTexture(Size(320, 240), rng) : imread(targetFile, 0);
+		if(target.empty()){
+			fprintf(stderr, "Error: could not read %s\n", targetFile.c_str());
+			return 2;
+		}
+		std::vector<Feature> features;
+		std::vector<std::vector<uint32_t> > indexTbl(INDEX_TABLE_SIZE);
+		processor.extractFeatures(target, features);
+		for(uint32_t i = 0; i < features.size(); i++){
+			indexTbl[features[i].index].push_back(i);
+		}
+		std::shared_ptr<modelDatabase> model = std::make_shared<modelDatabase>();
+		model->addTarget(target.size(), features, indexTbl);
+		processor.setModel(model);
+		truths.resize(numFrames);
+		description = "synthetic " + (targetFile.empty() ? std::string("random texture") : targetFile);
+	}
+	char text[64];
+	snprintf(text, sizeof(text), ", %d frames, %s, %d probes", numFrames,
+			 mode == MATCH_BY_BUCKET ? "bucket" : "feature", probeBudget);
+	description += text;
+
+	/**
+	 * Run and score every frame. Synthetic frames are rendered before
+	 * they are timed.
+	 */
+	std::vector<frameScore> scores(numFrames);
+	Mat rgb, output;
+	for(int f = 0; f < numFrames; f++){
+		if(recorded){
+			Mat nv21(frameSize.height * 3 / 2, frameSize.width, CV_8UC1,
+					 (void*)recording.frame(f));
+			cvtColor(nv21, rgb, CV_YUV2RGB_NV21);
+		}else{
+			syntheticFrame(target, frameSize, f, numFrames, rng, rgb, truths[f]);
+		}
+
+		timer::time_point t0 = timer::now();
+		processor.processFrame(rgb, output);
+		uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timer::now() - t0).count();
+		scores[f] = scoreFrame(*processor.getModel(), processor.getDetections(), truths[f], ns);
+	}
+
+	if(!csvFile.empty()){
+		FILE* dFile = fopen(csvFile.c_str(), "w");
+		if(dFile){
+			fprintf(dFile, "frame,target,found,correct,false_alarm,corner_err_px,latency_ms\n");
+			for(int f = 0; f < numFrames; f++){
+				const frameScore& s = scores[f];
+				fprintf(dFile, "%d,%d,%d,%d,%d,%.3f,%.3f\n", f, s.target, s.found, s.correct,
+						s.falseAlarm, s.cornerErr, s.ns * 1e-6);
+			}
+			fclose(dFile);
+		}
+	}
+
+	summary current = summarize(scores);
+	if(!saveFile.empty() && current.save(saveFile, description) != RET_SUCCESS){
+		fprintf(stderr, "Error: could not write %s\n", saveFile.c_str());
+		return 2;
+	}
+
+	/**
+	 * Report. Without a baseline the run is only described.
+	 */
+	printf("%s\n", description.c_str());
+	summary base;
+	if(baselineFile.empty()){
+		for(std::map<std::string, double>::const_iterator it = current.values.begin();
+			it != current.values.end(); ++it){
+			printf("%-20s %10.3f\n", it->first.c_str(), it->second);
+		}
+		return 0;
+	}
+	if(base.load(baselineFile) != RET_SUCCESS){
+		fprintf(stderr, "Error: could not read baseline %s\n", baselineFile.c_str());
+		return 2;
+	}
+	if(base.values["frames"] != current.values["frames"]){
+		fprintf(stderr, "Warning: baseline has %.0f frames, this run %.0f\n",
+				base.values["frames"], current.values["frames"]);
+	}
+
+	/**
+	 * Detection may not drop by more than 2 points, false alarms may not
+	 * rise by more than 1 point, corner errors may grow by 10% (p50) and
+	 * 20% (p95) plus a quarter pixel, latency by "latencyTol".
+	 */
+	std::map<std::string, double>& b = base.values;
+	std::map<std::string, double>& c = current.values;
+	printf("%-20s %10s %10s %10s\n", "metric", "baseline", "current", "limit");
+	bool pass = true;
+	pass &= check("detection_rate", b["detection_rate"], c["detection_rate"],
+				  b["detection_rate"] - 0.02, true);
+	pass &= check("false_alarm_rate", b["false_alarm_rate"], c["false_alarm_rate"],
+				  b["false_alarm_rate"] + 0.01, false);
+	pass &= check("corner_err_p50_px", b["corner_err_p50_px"], c["corner_err_p50_px"],
+				  b["corner_err_p50_px"] * 1.1 + 0.25, false);
+	pass &= check("corner_err_p95_px", b["corner_err_p95_px"], c["corner_err_p95_px"],
+				  b["corner_err_p95_px"] * 1.2 + 0.25, false);
+	if(latencyTol >= 0){
+		pass &= check("latency_p50_ms", b["latency_p50_ms"], c["latency_p50_ms"],
+					  b["latency_p50_ms"] * (1 + latencyTol), false);
+		pass &= check("latency_p95_ms", b["latency_p95_ms"], c["latency_p95_ms"],
+					  b["latency_p95_ms"] * (1 + latencyTol), false);
+	}
+	printf("%s\n", pass ? "PASS" : "FAIL");
+	return pass ? 0 : 1;
+}
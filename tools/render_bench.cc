@@ -0,0 +1,162 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ *
+ * Runs VideoOverlayApp headless on a Linux machine: the fake Tango
+ * service (jni/fake-tango) plays a recording on its camera thread at the
+ * camera rate, and this thread renders, as the GLSurfaceView of the app
+ * does, into an offscreen EGL pbuffer (headless_gl.h; Mesa's software
+ * rasteriser without a GPU). The whole path runs: camera callback, YUV
+ * buffer swap, NV21 conversion, processFrame, texture upload and draw.
+ *
+ *     render_bench [-size WxH] [-fps f] [-hz h] [-passes n] [-model model.bin]
+ *                  [-bench] [-trace out.json] <recording>
+ *
+ * -size is the size of the surface (default 1280x800), -fps the camera
+ * rate (default 30), -hz the render rate (default 60, 0: back to back),
+ * -passes the number of times the recording is played (default 1).
+ * -bench is the benchmark mode: every frame is rendered back to back
+ * (unless -hz is given) and the GL is waited for after the texture
+ * upload and after the draw, so that "texUpload" and "draw" are their
+ * full cost per frame. At the end the latency of every zone, the frames
+ * delivered and dropped by the camera and the frames rendered are
+ * printed; -trace writes the timeline as Chrome trace JSON.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "tango-video-handler/tango_handler.h"
+#include "tango-video-handler/headless_gl.h"
+#include "tango-video-handler/profiler.h"
+
+using namespace tango_video_overlay;
+
+namespace {
+
+typedef std::chrono::steady_clock timer;
+
+void usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-size WxH] [-fps f] [-hz h] [-passes n] [-model model.bin] "
+			"[-bench] [-trace out.json] <recording>\n", name);
+	exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	uint32_t width = 1280, height = 800, passes = 1;
+	double fps = 30.0, hz = -1.0;
+	bool bench = false;
+	std::string modelFile, traceFile;
+
+	int arg = 1;
+	for(; arg < argc && argv[arg][0] == '-'; arg++){
+		std::string opt = argv[arg];
+		if(opt == "-bench"){
+			bench = true;
+			continue;
+		}
+		if(arg + 1 >= argc){
+			usage(argv[0]);
+		}
+		const char* value = argv[++arg];
+		if(opt == "-size"){
+			if(sscanf(value, "%ux%u", &width, &height) != 2){
+				usage(argv[0]);
+			}
+		}else if(opt == "-fps"){
+			fps = atof(value);
+		}else if(opt == "-hz"){
+			hz = atof(value);
+		}else if(opt == "-passes"){
+			passes = std::max(1, atoi(value));
+		}else if(opt == "-model"){
+			modelFile = value;
+		}else if(opt == "-trace"){
+			traceFile = value;
+		}else{
+			usage(argv[0]);
+		}
+	}
+	if(argc - arg != 1){
+		usage(argv[0]);
+	}
+	if(hz < 0){
+		hz = bench ? 0.0 : 60.0;
+	}
+
+	headlessGL gl;
+	if(gl.create(width, height) != RET_SUCCESS){
+		return 1;
+	}
+	if(TangoFake_setRecording(argv[arg], 0, 0) != TANGO_SUCCESS){
+		return 1;
+	}
+	TangoFake_setFrameRate(fps, passes);
+
+	/**
+	 * Same sequence of calls as TangoJNINative from the activity and
+	 * its renderer
+	 */
+	VideoOverlayApp app;
+	if(app.TangoInitialize(NULL, NULL) != TANGO_SUCCESS ||
+	   (!modelFile.empty() && app.LoadTargetModel(modelFile) != RET_SUCCESS)){
+		fprintf(stderr, "Error: could not initialize the app\n");
+		return 1;
+	}
+	app.SetTextureMethod(VideoOverlayApp::kYUV);
+	app.SetFinishGL(bench);
+	app.InitializeGLContent();
+	app.SetViewPort(width, height);
+	if(app.TangoSetupConfig() != TANGO_SUCCESS || app.TangoConnect() != TANGO_SUCCESS){
+		fprintf(stderr, "Error: could not connect to the fake Tango service\n");
+		return 1;
+	}
+	if(!traceFile.empty()){
+		profiler::startTrace();
+	}
+
+	std::atomic<bool> ended(false);
+	std::thread waiter([&ended] { TangoFake_waitForEnd(); ended = true; });
+
+	// Render loop at "hz", until every pass has been delivered
+	timer::duration period = std::chrono::duration_cast<timer::duration>(
+			std::chrono::duration<double>(hz > 0 ? 1.0 / hz : 0.0));
+	timer::time_point start = timer::now(), next = start;
+	uint32_t numRenders = 0;
+	while(!ended){
+		app.Render();
+		gl.swapBuffers();
+		numRenders++;
+		if(hz > 0){
+			next += period;
+			std::this_thread::sleep_until(next);
+		}
+	}
+	double seconds = std::chrono::duration<double>(timer::now() - start).count();
+
+	app.TangoDisconnect();
+	waiter.join();
+	if(!traceFile.empty() && profiler::stopTrace(traceFile) != RET_SUCCESS){
+		fprintf(stderr, "Error: could not write %s\n", traceFile.c_str());
+	}
+
+	uint32_t delivered, dropped;
+	TangoFake_getStats(&delivered, &dropped);
+	printf("%s, %ux%u surface, %s\n", gl.renderer().c_str(), width, height,
+		   bench ? "benchmark (GL finished per stage)" : "load test");
+	printf("camera: %u frames delivered, %u dropped at %.1f fps; %u renders in %.2f s "
+		   "(%.1f Hz)\n", delivered, dropped, fps, numRenders, seconds, numRenders / seconds);
+	printf("%s", profiler::report().c_str());
+
+	app.FreeGLContent();
+	gl.destroy();
+	return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ *
+ * Replays recorded camera frames through frameProcessor at full speed
+ * and reports the p50/p95/p99 latency of every stage of the pipeline,
+ * and the overall frame rate, then the RHO and matcher counters
+ * (descriptor words read per candidate). Recording files are
+ * memory-mapped and paged in before the run, so that disk reads are not
+ * measured; every frame is converted from NV21 to RGB as the app does
+ * before processFrame().
+ *
+ *     replay [-size WxH] [-repeat n] [-probes n] [-bucket] [-trace out.json]
+ *            <model.bin> <recording file | directory of .nv21 frames>
+ *
+ * -size gives the size of raw .nv21 frames (recording files store it),
+ * -repeat plays the recording n times, -probes sets the multi-probe
+ * budget and -bucket matches by bucket instead of by feature. -trace
+ * writes the timeline of the run as Chrome trace JSON, with the same
+ * zones as a trace taken on the device.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "tango-video-handler/param.h"
+#include "tango-video-handler/frame_processor.h"
+#include "tango-video-handler/frame_recording.h"
+#include "tango-video-handler/profiler.h"
+#include "percentile.h"
+
+using namespace cv;
+
+namespace {
+
+typedef std::chrono::steady_clock timer;
+
+const int NUM_ROWS = NUM_FRAME_STAGES + 2;	// NV21 conversion, stages, whole frame
+
+void reportRow(const char* name, std::vector<uint64_t>& ns)
+{
+	double sum = 0;
+	for(size_t i = 0; i < ns.size(); i++){
+		sum += ns[i];
+	}
+	std::sort(ns.begin(), ns.end());
+	printf("%-10s %9.3f %9.3f %9.3f %9.3f\n", name,
+		   sortedPercentile(ns, 50) * 1e-6, sortedPercentile(ns, 95) * 1e-6,
+		   sortedPercentile(ns, 99) * 1e-6, ns.empty() ? 0.0 : sum / ns.size() * 1e-6);
+}
+
+void usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-size WxH] [-repeat n] [-probes n] [-bucket] "
+			"[-trace out.json] <model.bin> <recording>\n", name);
+	exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+	uint32_t width = 0, height = 0;
+	int numRepeats = 1, probeBudget = 0;
+	matchMode mode = MATCH_BY_FEATURE;
+	std::string traceFile;
+
+	int arg = 1;
+	for(; arg < argc && argv[arg][0] == '-'; arg++){
+		std::string opt = argv[arg];
+		if(opt == "-bucket"){
+			mode = MATCH_BY_BUCKET;
+		}else if(arg + 1 >= argc){
+			usage(argv[0]);
+		}else if(opt == "-size"){
+			if(sscanf(argv[++arg], "%ux%u", &width, &height) != 2){
+				usage(argv[0]);
+			}
+		}else if(opt == "-repeat"){
+			numRepeats = std::max(1, atoi(argv[++arg]));
+		}else if(opt == "-probes"){
+			probeBudget = atoi(argv[++arg]);
+		}else if(opt == "-trace"){
+			traceFile = argv[++arg];
+		}else{
+			usage(argv[0]);
+		}
+	}
+	if(argc - arg != 2){
+		usage(argv[0]);
+	}
+
+	frameProcessor processor;
+	processor.setMatchMode(mode);
+	processor.setProbeBudget(probeBudget);
+	if(processor.loadModelFromFile(argv[arg]) != RET_SUCCESS){
+		fprintf(stderr, "Error: could not load model %s\n", argv[arg]);
+		return 1;
+	}
+
+	frameRecording recording;
+	if(recording.open(argv[arg + 1], width, height) != RET_SUCCESS ||
+	   !recording.numFrames()){
+		fprintf(stderr, "Error: no frames in %s\n", argv[arg + 1]);
+		return 1;
+	}
+	modelSnapshot model = processor.getModel();
+
+	// Touch every page of the recording once
+	volatile uint8_t sum = 0;
+	for(uint32_t f = 0; f < recording.numFrames(); f++){
+		for(size_t b = 0; b < recording.frameSize(); b += 4096){
+			sum += recording.frame(f)[b];
+		}
+	}
+	printf("%u frames of %ux%u, %zu poses, %u targets, %u model features\n",
+		   recording.numFrames(), recording.width(), recording.height(),
+		   recording.poses().size(), model->numTargets(), model->numFeatures());
+
+	/**
+	 * Play the frames back to back, as fast as possible
+	 */
+	size_t numFrames = (size_t)recording.numFrames() * numRepeats;
+	std::vector<std::vector<uint64_t> > ns(NUM_ROWS, std::vector<uint64_t>(numFrames));
+	Mat rgb(recording.height(), recording.width(), CV_8UC3), output;
+	uint32_t numDetected = 0;
+
+	if(!traceFile.empty()){
+		profiler::setThreadName("replay");
+		profiler::startTrace();
+	}
+	timer::time_point start = timer::now();
+	for(size_t f = 0; f < numFrames; f++){
+		const uint8_t* data = recording.frame(f % recording.numFrames());
+		Mat nv21(recording.height() * 3 / 2, recording.width(), CV_8UC1, (void*)data);
+		profiler::setFrameId(f + 1);
+
+		timer::time_point t0 = timer::now();
+		PROFILE_TIMER(convertTimer, ZONE_YUV_TO_RGB, NULL);
+		cvtColor(nv21, rgb, CV_YUV2RGB_NV21);
+		PROFILE_STOP(convertTimer);
+		timer::time_point t1 = timer::now();
+		processor.processFrame(rgb, output);
+		timer::time_point t2 = timer::now();
+
+		const frameTiming& timing = processor.getFrameTiming();
+		ns[0][f] = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+		for(int s = 0; s < NUM_FRAME_STAGES; s++){
+			ns[1 + s][f] = timing.ns[s];
+		}
+		ns[NUM_ROWS - 1][f] = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t0).count();
+		numDetected += !processor.getDetections().empty();
+	}
+	double seconds = std::chrono::duration<double>(timer::now() - start).count();
+	if(!traceFile.empty() && profiler::stopTrace(traceFile) != RET_SUCCESS){
+		fprintf(stderr, "Error: could not write trace %s\n", traceFile.c_str());
+	}
+
+	printf("%-10s %9s %9s %9s %9s\n", "stage", "p50 ms", "p95 ms", "p99 ms", "mean ms");
+	reportRow("nv21", ns[0]);
+	for(int s = 0; s < NUM_FRAME_STAGES; s++){
+		reportRow(frameStageName(s), ns[1 + s]);
+	}
+	reportRow("frame", ns[NUM_ROWS - 1]);
+	printf("%zu frames in %.3f s: %.1f fps, target found in %u frames\n",
+		   numFrames, seconds, numFrames / seconds, numDetected);
+
+	/**
+	 * RHO counters, to tune the RANSAC_* parameters of param.h
+	 */
+	const estimatorStats& rho = processor.getEstimatorStats();
+	if(rho.runs){
+		printf("rho: %llu calls, %llu accepted, %llu capped at %d iterations\n",
+			   (unsigned long long)rho.runs, (unsigned long long)rho.accepted,
+			   (unsigned long long)rho.capped, RANSAC_MAX_ITER);
+		printf("rho: %.1f iterations per call (max %llu, mean bound %.1f), "
+			   "%.1f%% degenerate\n", (double)rho.iterations / rho.runs,
+			   (unsigned long long)rho.maxIterations, (double)rho.iterBound / rho.runs,
+			   rho.iterations ? 100.0 * rho.degenerate / rho.iterations : 0.0);
+		printf("rho: %.1f models per call, %.1f%% rejected by SPRT, %.1f points "
+			   "tested per model, %.1f LM iterations per call\n",
+			   (double)rho.models / rho.runs,
+			   rho.models ? 100.0 * rho.sprtRejected / rho.models : 0.0,
+			   rho.models ? (double)rho.tested / rho.models : 0.0,
+			   (double)rho.lmIterations / rho.runs);
+	}
+
+	/**
+	 * Matcher counters (TANGO_MATCH_STATS): descriptor words read per
+	 * candidate, out of DESCRIPTOR_SIZE without the early exit
+	 */
+	const matchStats& match = processor.getMatchStats();
+	if(match.candidates){
+		printf("match: %.1f candidates per frame, %.2f of %d descriptor words per candidate\n",
+			   (double)match.candidates / numFrames,
+			   (double)match.words / match.candidates, DESCRIPTOR_SIZE);
+	}
+	return 0;
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright 2015. All Rights Reserved.
+ * Author: Hamid Bazargani
+ */
+
+#ifndef TOOLS_SYNTHETIC_TEXTURE_H_
+#define TOOLS_SYNTHETIC_TEXTURE_H_
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+/**
+* Random blobby texture, rich in FAST corners, for synthetic targets and
+* backgrounds. Drawn from "rng" only, so that its seed fixes the image.
+*/
+static inline cv::Mat randomTexture(const cv::Size& size, cv::RNG& rng)
+{
+	cv::Mat small(size.height / 8, size.width / 8, CV_8UC1), texture;
+	rng.fill(small, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+	cv::resize(small, texture, size, 0, 0, cv::INTER_LINEAR);
+	return texture;
+}
+
+#endif  // TOOLS_SYNTHETIC_TEXTURE_H_